@@ -0,0 +1,31 @@
+#version 410
+
+layout(location = 0) in vec3 vertex;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec4 vertex_color;
+
+out vec3 vertex_out;
+out vec3 normal_out;
+out vec4 color_out;
+
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+// one placement of the node, meshes are shared between copies
+uniform mat4 model_matrix;
+
+// whole node fades in at once, over FADE_SECONDS from its spawn
+uniform float time;
+uniform float spawn;
+
+const float FADE_SECONDS = 1.4;
+
+void main(){
+    vec4 world = model_matrix * vec4(vertex, 1);
+
+    gl_Position = projection_matrix * view_matrix * world;
+
+    color_out = vec4(vertex_color.rgb, vertex_color.a * clamp((time - spawn) / FADE_SECONDS, 0.0, 1.0));
+    vertex_out = world.xyz;
+    normal_out = mat3(view_matrix) * mat3(model_matrix) * normal;
+}
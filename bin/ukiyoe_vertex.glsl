@@ -3,8 +3,9 @@
 layout(location = 0) in vec3 vertex;
 layout(location = 1) in vec3 normal;
 
+// dynamic instances, straight from the attributes: RGBA8 and vec4(position, scale)
 layout(location = 2) in vec4 model_color;
-layout(location = 3) in mat4 model_matrix;
+layout(location = 3) in vec4 model_position;
 
 out vec3 vertex_out;
 out vec3 normal_out;
@@ -13,10 +14,47 @@ out vec4 color_out;
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
 
+// seconds on the renderer clock, static voxels fade in over FADE_SECONDS from their spawn
+uniform float time;
+uniform float spawn;
+
+const float FADE_SECONDS = 1.4;
+
+// static instances, packed voxels resident in a buffer texture, picked by this frame's visible list
+uniform bool resident;
+uniform usamplerBuffer voxels;
+uniform usamplerBuffer visible;
+uniform int first;
+uniform vec3 origin;
+uniform mat4 placement;
+
 void main(){
-    gl_Position = projection_matrix * view_matrix * model_matrix * vec4(vertex, 1);
+    vec3 pos = model_position.xyz;
+    float scale = model_position.w;
+    vec4 color = model_color;
+
+    // cubes only turn by the placement of their prototype
+    mat3 turn = mat3(1.0);
+
+    if (resident)
+    {
+        // a 12 byte Voxel: x, y | z, scale | rgba8, positions in 1/16 and sizes in 1/256
+        uvec3 v = texelFetch(voxels, int(texelFetch(visible, first + gl_InstanceID).r)).xyz;
+
+        vec3 local = vec3(int(v.x << 16) >> 16, int(v.x) >> 16, int(v.y << 16) >> 16) / 16.0;
+
+        pos = (placement * vec4(origin + local, 1)).xyz;
+        scale = float(v.y >> 16) / 256.0;
+        turn = mat3(placement);
+        color = unpackUnorm4x8(v.z);
+        color.a *= clamp((time - spawn) / FADE_SECONDS, 0.0, 1.0);
+    }
+
+    vec3 corner = turn * (vertex * scale);
+
+    gl_Position = projection_matrix * view_matrix * vec4(pos + corner, 1);
 
-    color_out = model_color;
-    vertex_out = mat3(model_matrix) * vertex;
-    normal_out = mat3(view_matrix * model_matrix) * normal;
+    color_out = color;
+    vertex_out = corner;
+    normal_out = mat3(view_matrix) * turn * normal;
 }
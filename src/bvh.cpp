@@ -0,0 +1,182 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+struct VoxelAxisLess
+{
+    int axis;
+
+    VoxelAxisLess(int axis) : axis(axis)
+    {
+    }
+
+    bool operator()(const Voxel &a, const Voxel &b) const
+    {
+        return voxel_axis(a, axis) < voxel_axis(b, axis);
+    }
+};
+
+VoxelBVH::VoxelBVH()
+{
+}
+
+VoxelBVH::~VoxelBVH()
+{
+}
+
+void VoxelBVH::build(vector<Voxel> &voxels, const glm::vec3 &origin)
+{
+    nodes.clear();
+
+    if (!voxels.empty())
+    {
+        build_node(voxels, origin, 0, voxels.size(), true);
+    }
+}
+
+void VoxelBVH::build_ordered(const vector<Voxel> &voxels, const glm::vec3 &origin)
+{
+    nodes.clear();
+
+    if (!voxels.empty())
+    {
+        // never reorders, the cast only shares the recursion
+        build_node(const_cast<vector<Voxel> &>(voxels), origin, 0, voxels.size(), false);
+    }
+}
+
+int VoxelBVH::build_node(vector<Voxel> &voxels, const glm::vec3 &origin, int first, int count, bool reorder)
+{
+    int index = nodes.size();
+    nodes.push_back(BVHNode());
+
+    // a voxel cube spans pos +- scale, boxes are in world space
+    glm::vec3 min(voxel_pos(voxels[first], origin)), max(min);
+    glm::vec3 cmin(min), cmax(max);
+
+    for (int i = first; i < first + count; i++)
+    {
+        glm::vec3 pos = voxel_pos(voxels[i], origin);
+        float scale   = voxel_scale(voxels[i]);
+
+        min  = glm::min(min, pos - scale);
+        max  = glm::max(max, pos + scale);
+        cmin = glm::min(cmin, pos);
+        cmax = glm::max(cmax, pos);
+    }
+
+    nodes[index].min   = min;
+    nodes[index].max   = max;
+    nodes[index].first = first;
+    nodes[index].count = count;
+    nodes[index].left  = -1;
+    nodes[index].right = -1;
+    nodes[index].lod_first = 0;
+    nodes[index].lod_count = 0;
+
+    if (count <= BVH_LEAF_SIZE)
+    {
+        return index;
+    }
+
+    int half = count / 2;
+
+    if (reorder)
+    {
+        // median split along the longest axis of the voxel centres
+        glm::vec3 extent = cmax - cmin;
+        int axis = 0;
+
+        if (extent.y > extent[axis])
+        {
+            axis = 1;
+        }
+
+        if (extent.z > extent[axis])
+        {
+            axis = 2;
+        }
+
+        nth_element(voxels.begin() + first,
+                    voxels.begin() + first + half,
+                    voxels.begin() + first + count,
+                    VoxelAxisLess(axis));
+    }
+
+    int left  = build_node(voxels, origin, first, half, reorder);
+    int right = build_node(voxels, origin, first + half, count - half, reorder);
+
+    nodes[index].left  = left;
+    nodes[index].right = right;
+
+    return index;
+}
+
+/*
+    A sparse BVH_BRICK^3 grid over every node. Each occupied cell becomes
+    one cube that averages the colour of the voxels inside it, so a far
+    subtree can be drawn with a few dozen cubes instead of all of its own.
+*/
+void VoxelBVH::build_bricks(vector<Voxel> &voxels, const glm::vec3 &origin)
+{
+    const int cells = BVH_BRICK * BVH_BRICK * BVH_BRICK;
+
+    for (int index = 0; index < nodes.size(); index++)
+    {
+        BVHNode &node = nodes[index];
+        float cell = brick_cell(node);
+
+        node.lod_first = voxels.size();
+        node.lod_count = 0;
+
+        if (cell <= 0)
+        {
+            continue;
+        }
+
+        int occupied = 0;
+        int weight[cells] = { 0 };
+        glm::vec4 sum[cells];
+
+        for (int i = node.first; i < node.first + node.count; i++)
+        {
+            glm::vec3 pos = voxel_pos(voxels[i], origin);
+            int k = 0;
+
+            // z major, x minor
+            for (int axis = 2; axis >= 0; axis--)
+            {
+                int c = (int) floor((pos[axis] - node.min[axis]) / cell);
+                k = k * BVH_BRICK + std::min(BVH_BRICK - 1, std::max(0, c));
+            }
+
+            if (weight[k] == 0)
+            {
+                sum[k] = glm::vec4(0.0f);
+                occupied++;
+            }
+
+            sum[k] += voxel_color(voxels[i]);
+            weight[k]++;
+        }
+
+        if (occupied * 2 > node.count)
+        {
+            continue;
+        }
+
+        for (int k = 0; k < cells; k++)
+        {
+            if (weight[k] > 0)
+            {
+                glm::vec3 c(k % BVH_BRICK, (k / BVH_BRICK) % BVH_BRICK, k / (BVH_BRICK * BVH_BRICK));
+                glm::vec3 centre = node.min + (c + 0.5f) * cell;
+
+                voxels.push_back(make_voxel(centre - origin, cell / 2, sum[k] / (float) weight[k]));
+            }
+        }
+
+        node.lod_count = voxels.size() - node.lod_first;
+    }
+}
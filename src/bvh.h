@@ -0,0 +1,64 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "voxel.h"
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#define BVH_LEAF_SIZE 32
+
+// coarse cells per side of a node's brick
+#define BVH_BRICK 4
+
+/*
+    Every node covers a contiguous range of the voxel array, so a box
+    that is fully visible hands out its whole subtree as one range.
+*/
+struct BVHNode
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // children, -1 at the leaves
+    int left;
+    int right;
+
+    int first;
+    int count;
+
+    // coarse stand-ins for the whole subtree, stored after the fine voxels;
+    // lod_count is 0 where a brick would not at least halve the subtree
+    int lod_first;
+    int lod_count;
+};
+
+// edge of one brick cell, bricks are cubic and span the longest side
+inline float brick_cell(const BVHNode &node)
+{
+    glm::vec3 extent = node.max - node.min;
+    return std::max(extent.x, std::max(extent.y, extent.z)) / BVH_BRICK;
+}
+
+class VoxelBVH
+{
+public:
+    vector<BVHNode> nodes;
+
+    VoxelBVH();
+    ~VoxelBVH();
+
+    // static content, sorts the voxels into spatially coherent leaves
+    void build(vector<Voxel> &voxels, const glm::vec3 &origin);
+
+    // dynamic content, keeps the voxel order and splits by index
+    void build_ordered(const vector<Voxel> &voxels, const glm::vec3 &origin);
+
+    // static content after build(), appends every node's brick to voxels
+    void build_bricks(vector<Voxel> &voxels, const glm::vec3 &origin);
+
+private:
+    int build_node(vector<Voxel> &voxels, const glm::vec3 &origin, int first, int count, bool reorder);
+};
+
+#endif
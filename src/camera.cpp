@@ -55,6 +55,8 @@ void Camera::update()
     // compute the projection, view matrix
     projection = glm::perspective(field_of_view, aspect, near_clip, far_clip);
     view       = glm::lookAt(camera_position, camera_look_at, camera_up);
+
+    frustum.extract(projection * view);
 }
 
 void Camera::move(int key)
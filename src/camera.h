@@ -9,6 +9,8 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "frustum.h"
+
 class Camera
 {
 public:
@@ -29,6 +31,9 @@ public:
     glm::mat4 projection;
     glm::mat4 view;
 
+    // planes of projection * view, extracted once per update
+    Frustum frustum;
+
     glm::vec3 camera_position_delta;
     glm::vec3 camera_direction;
 
@@ -0,0 +1,162 @@
+#include "cull.h"
+
+#ifdef __AVX__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// a cube spans pos +- scale, its corners sit sqrt(3) * scale away
+#define CUBE_RADIUS 1.7320508f
+
+// cos and sin of the quarter turns
+static const float TURN_COS[4] = { 1, 0, -1, 0 };
+static const float TURN_SIN[4] = { 0, 1, 0, -1 };
+
+glm::mat4 Placement::model() const
+{
+    float c = TURN_COS[yaw & 3];
+    float s = TURN_SIN[yaw & 3];
+
+    glm::mat4 m(1.0f);
+    m[0][0] = c;
+    m[0][2] = -s;
+    m[2][0] = s;
+    m[2][2] = c;
+    m[3] = glm::vec4(offset, 1);
+
+    return m;
+}
+
+glm::vec3 Placement::apply(const glm::vec3 &p) const
+{
+    float c = TURN_COS[yaw & 3];
+    float s = TURN_SIN[yaw & 3];
+
+    return glm::vec3(c * p.x + s * p.z, p.y, c * p.z - s * p.x) + offset;
+}
+
+void VoxelSoA::build(const vector<Voxel> &voxels, const glm::vec3 &origin)
+{
+    int count = voxels.size();
+
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    radius.resize(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        glm::vec3 pos = voxel_pos(voxels[i], origin);
+
+        x[i]      = pos.x;
+        y[i]      = pos.y;
+        z[i]      = pos.z;
+        radius[i] = voxel_scale(voxels[i]) * CUBE_RADIUS;
+    }
+}
+
+static inline int emit(unsigned int mask, int base, int *visible, int n)
+{
+    while (mask)
+    {
+        int bit = __builtin_ctz(mask);
+        visible[n++] = base + bit;
+        mask &= mask - 1;
+    }
+
+    return n;
+}
+
+int cull_spheres(const VoxelSoA &soa, int first, int count, const Frustum &frustum, int *visible)
+{
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    const float *px = &soa.x[0];
+    const float *py = &soa.y[0];
+    const float *pz = &soa.z[0];
+    const float *pr = &soa.radius[0];
+
+    const glm::vec4 *planes = frustum.planes;
+
+    int n   = 0;
+    int i   = first;
+    int end = first + count;
+
+#ifdef __AVX__
+    // 8 spheres per iteration, a lane survives while distance >= -radius on every plane
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(px + i);
+        __m256 y = _mm256_loadu_ps(py + i);
+        __m256 z = _mm256_loadu_ps(pz + i);
+        __m256 r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(pr + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(planes[p].x)),
+                                                   _mm256_mul_ps(y, _mm256_set1_ps(planes[p].y))),
+                                     _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(planes[p].z)),
+                                                   _mm256_set1_ps(planes[p].w)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, r, _CMP_GE_OQ));
+        }
+
+        n = emit(_mm256_movemask_ps(inside), i, visible, n);
+    }
+#elif defined(__SSE2__)
+    // two SSE groups, 8 spheres per iteration
+    for (; i + 8 <= end; i += 8)
+    {
+        __m128 x0 = _mm_loadu_ps(px + i), x1 = _mm_loadu_ps(px + i + 4);
+        __m128 y0 = _mm_loadu_ps(py + i), y1 = _mm_loadu_ps(py + i + 4);
+        __m128 z0 = _mm_loadu_ps(pz + i), z1 = _mm_loadu_ps(pz + i + 4);
+        __m128 r0 = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(pr + i));
+        __m128 r1 = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(pr + i + 4));
+
+        __m128 in0 = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 in1 = in0;
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 a = _mm_set1_ps(planes[p].x);
+            __m128 b = _mm_set1_ps(planes[p].y);
+            __m128 c = _mm_set1_ps(planes[p].z);
+            __m128 w = _mm_set1_ps(planes[p].w);
+
+            __m128 d0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, a), _mm_mul_ps(y0, b)),
+                                   _mm_add_ps(_mm_mul_ps(z0, c), w));
+            __m128 d1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x1, a), _mm_mul_ps(y1, b)),
+                                   _mm_add_ps(_mm_mul_ps(z1, c), w));
+
+            in0 = _mm_and_ps(in0, _mm_cmpge_ps(d0, r0));
+            in1 = _mm_and_ps(in1, _mm_cmpge_ps(d1, r1));
+        }
+
+        unsigned int mask = _mm_movemask_ps(in0) | (_mm_movemask_ps(in1) << 4);
+        n = emit(mask, i, visible, n);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        bool inside = true;
+
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            float d = planes[p].x * px[i] + planes[p].y * py[i] + planes[p].z * pz[i] + planes[p].w;
+            inside = d >= -pr[i];
+        }
+
+        if (inside)
+        {
+            visible[n++] = i;
+        }
+    }
+
+    return n;
+}
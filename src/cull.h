@@ -0,0 +1,71 @@
+#ifndef CULL_H_
+#define CULL_H_
+
+#include "voxel.h"
+#include "frustum.h"
+
+#include <vector>
+using namespace std;
+
+/*
+    Packed bounding spheres of a node, the culling kernel streams these
+    instead of whole Voxels. The radius encloses the whole cube, so a
+    voxel is only dropped once no corner can reach the screen.
+*/
+struct VoxelSoA
+{
+    vector<float> x;
+    vector<float> y;
+    vector<float> z;
+    vector<float> radius;
+
+    // world space, voxels are stored relative to origin
+    void build(const vector<Voxel> &voxels, const glm::vec3 &origin);
+};
+
+/*
+    Where one copy of a prototype node stands. Turns are quarter turns about
+    y, so the cubes stay axis aligned and the node's boxes stay exact.
+*/
+struct Placement
+{
+    glm::vec3 offset;
+    int yaw;
+
+    bool identity() const
+    {
+        return yaw == 0 && offset == glm::vec3(0.0f);
+    }
+
+    // prototype space to world space
+    glm::mat4 model() const;
+    glm::vec3 apply(const glm::vec3 &p) const;
+};
+
+/*
+    One unit of parallel culling, a BVH subtree of a scene node. After the
+    prefix sum its survivors own slots [offset, offset + visible.size()), in
+    the visible index list for static nodes and the instance buffers otherwise.
+*/
+struct CullBatch
+{
+    int node;
+    int root;
+
+    vector<Voxel> *voxels;
+    glm::vec3 origin;
+    Placement placement;
+    vector<int> visible;
+
+    int offset;
+
+    // renderer copy of a static node's voxels, -1 for dynamic nodes whose
+    // instances are packed every frame
+    int resident;
+};
+
+// writes the indices of the spheres in [first, first + count) that touch the
+// frustum to visible, returns how many
+int cull_spheres(const VoxelSoA &soa, int first, int count, const Frustum &frustum, int *visible);
+
+#endif
@@ -0,0 +1,86 @@
+#include "frustum.h"
+
+Frustum::Frustum()
+{
+}
+
+Frustum::~Frustum()
+{
+}
+
+void Frustum::extract(const glm::mat4 &pv)
+{
+    // glm is column major, row i is (pv[0][i], pv[1][i], pv[2][i], pv[3][i])
+    glm::vec4 row[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        row[i] = glm::vec4(pv[0][i], pv[1][i], pv[2][i], pv[3][i]);
+    }
+
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[3] + row[2];
+    planes[5] = row[3] - row[2];
+
+    for (int i = 0; i < 6; i++)
+    {
+        float len = glm::length(glm::vec3(planes[i]));
+
+        // an infinite far clip leaves no far plane, let everything pass it
+        if (len < 1e-6f)
+        {
+            planes[i] = glm::vec4(0, 0, 0, 1);
+            continue;
+        }
+
+        planes[i] /= len;
+    }
+}
+
+Frustum Frustum::transformed(const glm::mat4 &model) const
+{
+    // dot(plane, model * p) == dot(transpose(model) * plane, p), a rigid
+    // model keeps the normals unit length
+    glm::mat4 t = glm::transpose(model);
+    Frustum local;
+
+    for (int i = 0; i < 6; i++)
+    {
+        local.planes[i] = t * planes[i];
+    }
+
+    return local;
+}
+
+int Frustum::test_box(const glm::vec3 &min, const glm::vec3 &max) const
+{
+    int result = FRUSTUM_INSIDE;
+
+    for (int i = 0; i < 6; i++)
+    {
+        const glm::vec4 &p = planes[i];
+
+        // corner furthest along the normal, and the one opposite to it
+        glm::vec3 far_corner(p.x > 0 ? max.x : min.x,
+                             p.y > 0 ? max.y : min.y,
+                             p.z > 0 ? max.z : min.z);
+        glm::vec3 near_corner(p.x > 0 ? min.x : max.x,
+                              p.y > 0 ? min.y : max.y,
+                              p.z > 0 ? min.z : max.z);
+
+        if (glm::dot(glm::vec3(p), far_corner) + p.w < 0)
+        {
+            return FRUSTUM_OUTSIDE;
+        }
+
+        if (glm::dot(glm::vec3(p), near_corner) + p.w < 0)
+        {
+            result = FRUSTUM_INTERSECT;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#define FRUSTUM_OUTSIDE     0
+#define FRUSTUM_INTERSECT   1
+#define FRUSTUM_INSIDE      2
+
+/*
+    View frustum as six planes, inside is dot(plane, vec4(p, 1)) >= 0
+*/
+
+class Frustum
+{
+public:
+    // left, right, bottom, top, near, far
+    glm::vec4 planes[6];
+
+    Frustum();
+    ~Frustum();
+
+    // Gribb / Hartmann extraction from projection * view
+    void extract(const glm::mat4 &pv);
+
+    // the same frustum in the space model maps to world, model must be rigid
+    Frustum transformed(const glm::mat4 &model) const;
+
+    int test_box(const glm::vec3 &min, const glm::vec3 &max) const;
+};
+
+#endif
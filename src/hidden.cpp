@@ -0,0 +1,90 @@
+#include "hidden.h"
+
+#include <cmath>
+#include <stdint.h>
+#include <unordered_map>
+
+// positions are already fixed point, equal cells are equal positions
+static uint64_t cell_key(int x, int y, int z)
+{
+    return ((uint64_t) (x & 0x1fffff) << 42) | ((uint64_t) (y & 0x1fffff) << 21) | (uint64_t) (z & 0x1fffff);
+}
+
+int remove_hidden(vector<Voxel> &voxels)
+{
+    int before = voxels.size();
+
+    unordered_map<uint64_t, int> cells;
+    cells.reserve(before * 2);
+
+    // duplicates, the first voxel at a cell keeps its colour
+    int kept = 0;
+
+    for (int i = 0; i < before; ++i)
+    {
+        uint64_t key = cell_key(voxels[i].x, voxels[i].y, voxels[i].z);
+
+        unordered_map<uint64_t, int>::iterator it = cells.find(key);
+
+        if (it != cells.end() && voxels[it->second].scale == voxels[i].scale)
+        {
+            continue;
+        }
+
+        voxels[kept] = voxels[i];
+        cells[key] = kept;
+        kept++;
+    }
+
+    voxels.resize(kept);
+
+    // fully enclosed, every face touches a same sized cube; decided against
+    // the whole set so removing one never exposes another
+    vector<char> hidden(kept, 0);
+
+    for (int i = 0; i < kept; ++i)
+    {
+        const Voxel &v = voxels[i];
+
+        // a full edge, in position steps
+        int step = floor(2 * voxel_scale(v) * VOXEL_UNIT + 0.5f);
+
+        int offsets[6][3] =
+        {
+            {  step, 0, 0 }, { -step, 0, 0 },
+            { 0,  step, 0 }, { 0, -step, 0 },
+            { 0, 0,  step }, { 0, 0, -step }
+        };
+
+        int covered = 0;
+
+        for (int f = 0; f < 6; ++f)
+        {
+            uint64_t key = cell_key(v.x + offsets[f][0], v.y + offsets[f][1], v.z + offsets[f][2]);
+            unordered_map<uint64_t, int>::iterator it = cells.find(key);
+
+            if (it == cells.end() || voxels[it->second].scale != v.scale)
+            {
+                break;
+            }
+
+            covered++;
+        }
+
+        hidden[i] = covered == 6;
+    }
+
+    int count = 0;
+
+    for (int i = 0; i < kept; ++i)
+    {
+        if (!hidden[i])
+        {
+            voxels[count++] = voxels[i];
+        }
+    }
+
+    voxels.resize(count);
+
+    return before - count;
+}
@@ -0,0 +1,16 @@
+#ifndef HIDDEN_H_
+#define HIDDEN_H_
+
+#include "voxel.h"
+#include <vector>
+using namespace std;
+
+/*
+    Post-generation cleanup for static voxels. Coincident cubes of the same
+    size collapse into the first one, and cubes whose six faces are all
+    flush against a neighbour of the same size are dropped, nothing can
+    see them. Order of the survivors is kept. Returns how many were removed.
+*/
+int remove_hidden(vector<Voxel> &voxels);
+
+#endif
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <ctime>
 
 #include <GL/glew.h>
@@ -24,9 +25,35 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
-    if ((key == GLFW_KEY_SPACE) && (action == GLFW_PRESS))
+    if ((key == GLFW_KEY_O) && (action == GLFW_PRESS))
+    {
+        scene -> toggleOcclusion();
+    }
+
+    if ((key == GLFW_KEY_L) && (action == GLFW_PRESS))
+    {
+        scene -> toggleLod();
+    }
+
+    if ((key == GLFW_KEY_T) && (action == GLFW_PRESS))
+    {
+        scene -> toggleStreaming();
+    }
+
+    if ((key == GLFW_KEY_F) && (action == GLFW_PRESS))
     {
+        scene -> toggleWave();
+    }
+
+    if ((key == GLFW_KEY_M) && (action == GLFW_PRESS))
+    {
+        scene -> toggleMeshed();
         scene -> reset();
+    }
+
+    if ((key == GLFW_KEY_SPACE) && (action == GLFW_PRESS))
+    {
+        scene -> reset(true);
 
         printf("camera:\t%f, %f, %f\n",
                camera->camera_position.x,
@@ -54,7 +81,7 @@ static void mouse_button_callback(GLFWwindow *window, int button, int action, in
     // }
     if ((button == GLFW_MOUSE_BUTTON_LEFT) && (action == GLFW_RELEASE))
     {
-        scene -> reset();
+        scene -> reset(true);
     }
 
     if ((button == GLFW_MOUSE_BUTTON_RIGHT) && (action == GLFW_RELEASE))
@@ -100,7 +127,7 @@ void _update_fps_counter(GLFWwindow *window)
         previous_seconds = current_seconds;
         double fps = (double)frame_count / elapsed_seconds;
         char tmp[128];
-        sprintf(tmp, "Ukiyoe @ fps: %.2f § Voxel: %d", fps,  (int)scene->render_node.size());
+        sprintf(tmp, "Ukiyoe @ fps: %.2f § Voxel: %d", fps,  scene->render_count);
         glfwSetWindowTitle(window, tmp);
         frame_count = 0;
     }
@@ -110,7 +137,8 @@ void _update_fps_counter(GLFWwindow *window)
 
 int main(int argc, char **argv)
 {
-    srand(time(0));
+    // pass a seed to rebuild a scene exactly
+    unsigned int seed = argc > 1 ? strtoul(argv[1], NULL, 10) : time(0);
 
     GLFWwindow *window;
 
@@ -163,7 +191,7 @@ int main(int argc, char **argv)
     camera->camera_position = glm::vec3(400.263855, 30.000000, 264.931793);
     camera->camera_look_at  = glm::vec3(0.000000, 60.000000, 0.000000);
 
-    scene                   = new Scene();
+    scene                   = new Scene(seed);
 
     while (!glfwWindowShouldClose(window))
     {
@@ -178,6 +206,9 @@ int main(int argc, char **argv)
         glfwPollEvents();
     }
 
+    // while the context is still current, the scene frees GL objects and saves the wave
+    delete scene;
+
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -0,0 +1,208 @@
+#include "mesher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <tuple>
+#include <utility>
+
+// faces are matched in 1/256 units, exact for both positions and sizes
+#define MESH_GRID VOXEL_SCALE
+
+typedef std::tuple<int, int, int> Cell;
+
+// direction, scale, plane, the two in-plane grid phases, colour
+typedef std::tuple<int, int, int, int, int, unsigned int> FaceGroup;
+
+static void fixed_pos(const Voxel &v, int q[3])
+{
+    int step = (int) (VOXEL_SCALE / VOXEL_UNIT);
+
+    q[0] = v.x * step;
+    q[1] = v.y * step;
+    q[2] = v.z * step;
+}
+
+static int floor_div(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static unsigned int pack_color(const Voxel &v)
+{
+    return (v.color[0] << 16) | (v.color[1] << 8) | v.color[2];
+}
+
+static void emit_quad(const glm::vec3 &origin, const glm::vec3 &u, const glm::vec3 &v, const glm::vec3 &normal,
+                      const glm::vec4 &color, vector<MeshVertex> &vertices, vector<unsigned int> &indices)
+{
+    unsigned int base = vertices.size();
+
+    glm::vec3 corners[4] = { origin, origin + u, origin + u + v, origin + v };
+
+    for (int i = 0; i < 4; i++)
+    {
+        MeshVertex vertex;
+        vertex.pos    = corners[i];
+        vertex.normal = normal;
+        vertex.color  = color;
+        vertices.push_back(vertex);
+    }
+
+    // u x v points along the normal, so this is counter clockwise from outside
+    indices.push_back(base);
+    indices.push_back(base + 1);
+    indices.push_back(base + 2);
+    indices.push_back(base);
+    indices.push_back(base + 2);
+    indices.push_back(base + 3);
+}
+
+int greedy_mesh(const vector<Voxel> &voxels, const glm::vec3 &origin, vector<MeshVertex> &vertices, vector<unsigned int> &indices)
+{
+    vertices.clear();
+    indices.clear();
+
+    // occupancy by exact position and size, for the flush face test
+    set<std::pair<Cell, int> > occupied;
+
+    for (int i = 0; i < voxels.size(); ++i)
+    {
+        int q[3];
+        fixed_pos(voxels[i], q);
+
+        occupied.insert(std::make_pair(Cell(q[0], q[1], q[2]), (int) voxels[i].scale));
+    }
+
+    // exposed faces bucketed per plane, as cells of a 2 * scale grid
+    map<FaceGroup, set<std::pair<int, int> > > groups;
+
+    for (int i = 0; i < voxels.size(); ++i)
+    {
+        const Voxel &v = voxels[i];
+
+        int q[3];
+        fixed_pos(v, q);
+
+        int scale = v.scale;
+        int pitch = 2 * scale;
+
+        if (scale <= 0)
+        {
+            continue;
+        }
+
+        for (int dir = 0; dir < 6; ++dir)
+        {
+            int axis = dir / 2;
+            int sign = (dir & 1) ? -1 : 1;
+
+            int n[3] = { q[0], q[1], q[2] };
+            n[axis] += sign * pitch;
+
+            if (occupied.count(std::make_pair(Cell(n[0], n[1], n[2]), scale)))
+            {
+                continue;
+            }
+
+            // in-plane axes, ordered so that u x v is +axis
+            int a = (axis + 1) % 3;
+            int b = (axis + 2) % 3;
+
+            int ca = floor_div(q[a], pitch);
+            int cb = floor_div(q[b], pitch);
+
+            FaceGroup group(dir, scale, q[axis], q[a] - ca * pitch, q[b] - cb * pitch, pack_color(v));
+            groups[group].insert(std::make_pair(cb, ca));
+        }
+    }
+
+    int quads = 0;
+
+    for (map<FaceGroup, set<std::pair<int, int> > >::iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+        int dir   = std::get<0>(it->first);
+        int scale = std::get<1>(it->first);
+        int plane = std::get<2>(it->first);
+        int phase_a = std::get<3>(it->first);
+        int phase_b = std::get<4>(it->first);
+        unsigned int packed = std::get<5>(it->first);
+
+        int axis  = dir / 2;
+        int sign  = (dir & 1) ? -1 : 1;
+        int pitch = 2 * scale;
+
+        int a = (axis + 1) % 3;
+        int b = (axis + 2) % 3;
+
+        glm::vec4 color(((packed >> 16) & 0xff) / 255.0f, ((packed >> 8) & 0xff) / 255.0f, (packed & 0xff) / 255.0f, 1.0f);
+
+        glm::vec3 normal(0.0f);
+        normal[axis] = sign;
+
+        set<std::pair<int, int> > &cells = it->second;
+
+        // rows in b, runs in a; grow a run along a, then grow it along b while whole rows fit
+        while (!cells.empty())
+        {
+            int cb = cells.begin()->first;
+            int ca = cells.begin()->second;
+
+            int width = 1;
+            while (cells.count(std::make_pair(cb, ca + width)))
+            {
+                width++;
+            }
+
+            int height = 1;
+            for (;;)
+            {
+                bool full = true;
+
+                for (int k = 0; k < width && full; ++k)
+                {
+                    full = cells.count(std::make_pair(cb + height, ca + k)) > 0;
+                }
+
+                if (!full)
+                {
+                    break;
+                }
+
+                height++;
+            }
+
+            for (int j = 0; j < height; ++j)
+            {
+                for (int k = 0; k < width; ++k)
+                {
+                    cells.erase(std::make_pair(cb + j, ca + k));
+                }
+            }
+
+            glm::vec3 corner;
+            corner[axis] = origin[axis] + (plane + sign * scale) / MESH_GRID;
+            corner[a]    = origin[a] + (ca * pitch + phase_a - scale) / MESH_GRID;
+            corner[b]    = origin[b] + (cb * pitch + phase_b - scale) / MESH_GRID;
+
+            glm::vec3 u(0.0f), v(0.0f);
+            u[a] = width * pitch / MESH_GRID;
+            v[b] = height * pitch / MESH_GRID;
+
+            // a back face runs the other way round
+            if (sign > 0)
+            {
+                emit_quad(corner, u, v, normal, color, vertices, indices);
+            }
+            else
+            {
+                emit_quad(corner, v, u, normal, color, vertices, indices);
+            }
+
+            quads++;
+        }
+    }
+
+    return quads;
+}
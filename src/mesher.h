@@ -0,0 +1,25 @@
+#ifndef MESHER_H_
+#define MESHER_H_
+
+#include "voxel.h"
+#include <vector>
+using namespace std;
+
+struct MeshVertex
+{
+    glm::vec3 pos;
+    glm::vec3 normal;
+    glm::vec4 color;
+};
+
+/*
+    Turns static voxels into plain triangles once, at generation time.
+    Faces flush against a same sized cube are dropped, and the exposed
+    faces of one colour that tile a plane are merged into larger quads.
+    Colours come out opaque, the renderer fades the whole node in.
+    Vertices are in world space, the voxels relative to origin.
+    Returns the number of quads.
+*/
+int greedy_mesh(const vector<Voxel> &voxels, const glm::vec3 &origin, vector<MeshVertex> &vertices, vector<unsigned int> &indices);
+
+#endif
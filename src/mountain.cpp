@@ -1,12 +1,23 @@
 #include "mountain.h"
 
-Mountain::Mountain(float _x, float _y, float _z)
+#include <random>
+
+Mountain::Mountain(float _x, float _y, float _z, unsigned int seed)
 {
     xPos = _x;
     yPos = _y;
     zPos = _z;
+
+    generate(seed);
+}
+
+void Mountain::generate(unsigned int seed)
+{
+    // clear keeps the capacity of the last generation
     voxels.clear();
 
+    std::mt19937 rng(seed);
+
     for (int i = 0; i < 360; ++i)
     {
         for (int j = 0; j < 52; ++j)
@@ -18,25 +29,86 @@ Mountain::Mountain(float _x, float _y, float _z)
             float tmpz = z / 26.0;
             float tmpy = pow(M_E, -tmpx * tmpx - tmpz * tmpz) * 96;
 
-            Voxel tmp;
-            tmp.scale = 0.65;
+            glm::vec4 color = glm::vec4(31, 71, 136, 255) / 255.0f;
 
-            tmp.color = glm::vec4(31, 71, 136, 0) / 255.0f;
-
-            if ((tmpy > 32) && (rand() % 2 == 1))
-                tmp.color = glm::vec4(235, 246, 247, 0) / 255.0f;
+            if ((tmpy > 32) && (rng() % 2 == 1))
+                color = glm::vec4(235, 246, 247, 255) / 255.0f;
 
             if (tmpy > 64)
-                tmp.color = glm::vec4(235, 246, 247, 0) / 255.0f;
+                color = glm::vec4(235, 246, 247, 255) / 255.0f;
 
             if (tmpy >= 88)
-                tmp.color = glm::vec4(198, 194, 182, 0) / 255.0f;
+                color = glm::vec4(198, 194, 182, 255) / 255.0f;
 
             if (tmpy >= 92)
                 continue;
 
-            tmp.pos = glm::vec3(xPos + x * 2.5, yPos + tmpy, zPos + z * 2.5);
-            voxels.push_back(tmp);
+            // relative to the mountain's origin
+            voxels.push_back(make_voxel(glm::vec3(x * 2.5, tmpy, z * 2.5), 0.65, color));
+        }
+    }
+
+    buildOccluder();
+}
+
+/*
+    The voxels sit on 96 * exp(-(r / 65)^2). The proxy follows the same curve
+    a few units lower so its flat triangles stay inside the slope, and is
+    capped below the crater.
+*/
+void Mountain::buildOccluder()
+{
+    const int   cells  = 24;
+    const float extent = 120;
+    const float sink   = 6;
+    const float cap    = 80;
+
+    float step = 2 * extent / cells;
+
+    vector<float> h((cells + 1) * (cells + 1));
+
+    for (int j = 0; j <= cells; ++j)
+    {
+        for (int i = 0; i <= cells; ++i)
+        {
+            float x = -extent + i * step;
+            float z = -extent + j * step;
+
+            float y = pow(M_E, -(x * x + z * z) / (65.0 * 65.0)) * 96 - sink;
+            h[j * (cells + 1) + i] = y < cap ? y : cap;
+        }
+    }
+
+    occluder.clear();
+
+    for (int j = 0; j < cells; ++j)
+    {
+        for (int i = 0; i < cells; ++i)
+        {
+            float h00 = h[j * (cells + 1) + i];
+            float h10 = h[j * (cells + 1) + i + 1];
+            float h01 = h[(j + 1) * (cells + 1) + i];
+            float h11 = h[(j + 1) * (cells + 1) + i + 1];
+
+            // the foothills are lower than the sink, nothing to hide there
+            if (h00 <= 0 && h10 <= 0 && h01 <= 0 && h11 <= 0)
+                continue;
+
+            float x0 = xPos - extent + i * step, x1 = x0 + step;
+            float z0 = zPos - extent + j * step, z1 = z0 + step;
+
+            glm::vec3 a(x0, yPos + h00, z0);
+            glm::vec3 b(x1, yPos + h10, z0);
+            glm::vec3 c(x0, yPos + h01, z1);
+            glm::vec3 d(x1, yPos + h11, z1);
+
+            occluder.push_back(a);
+            occluder.push_back(b);
+            occluder.push_back(d);
+
+            occluder.push_back(a);
+            occluder.push_back(d);
+            occluder.push_back(c);
         }
     }
 }
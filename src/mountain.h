@@ -11,8 +11,18 @@ public:
     float xPos, yPos, zPos;
     vector<Voxel> voxels;
 
-    Mountain(float _x, float _y, float _z);
+    // coarse solid stand-in for the occlusion buffer, a triangle list
+    vector<glm::vec3> occluder;
+
+    // the seed scatters the snow on the slopes
+    Mountain(float _x, float _y, float _z, unsigned int seed);
     ~Mountain();
+
+    // regrows in place, reusing the voxel storage
+    void generate(unsigned int seed);
+
+private:
+    void buildOccluder();
 };
 
 #endif
@@ -0,0 +1,284 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// anything closer than this straddles the eye, leave it to the frustum test
+#define NEAR_W 0.1f
+
+OcclusionBuffer::OcclusionBuffer(int width, int height)
+    : width(width),
+      height(height)
+{
+    // width and height are powers of two, at least 4 wide
+    for (int level = 0; level_width(level) >= 1 && level_height(level) >= 1; level++)
+    {
+        max_mips.push_back(vector<float>(level_width(level) * level_height(level), FLT_MAX));
+        min_mips.push_back(vector<float>(level_width(level) * level_height(level), FLT_MAX));
+    }
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+}
+
+void OcclusionBuffer::clear()
+{
+    std::fill(max_mips[0].begin(), max_mips[0].end(), FLT_MAX);
+}
+
+void OcclusionBuffer::rasterize(const glm::mat4 &pv, const vector<glm::vec3> &triangles)
+{
+    for (int t = 0; t + 2 < triangles.size(); t += 3)
+    {
+        glm::vec3 s[3];
+        float depth = 0;
+        bool behind = false;
+
+        for (int v = 0; v < 3; v++)
+        {
+            glm::vec4 clip = pv * glm::vec4(triangles[t + v], 1);
+
+            if (clip.w < NEAR_W)
+            {
+                behind = true;
+                break;
+            }
+
+            s[v] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * width,
+                             (clip.y / clip.w * 0.5f + 0.5f) * height,
+                             clip.w);
+            depth = std::max(depth, clip.w);
+        }
+
+        // dropping an occluder is always safe
+        if (!behind)
+        {
+            triangle(s[0], s[1], s[2], depth);
+        }
+    }
+}
+
+void OcclusionBuffer::triangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, float depth)
+{
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+
+    if (fabs(area) < 1e-6f)
+    {
+        return;
+    }
+
+    // counter clockwise, so all edge functions are positive inside
+    if (area < 0)
+    {
+        std::swap(b, c);
+    }
+
+    int x0 = std::max(0, (int) floor(std::min(a.x, std::min(b.x, c.x))));
+    int x1 = std::min(width - 1, (int) ceil(std::max(a.x, std::max(b.x, c.x))));
+    int y0 = std::max(0, (int) floor(std::min(a.y, std::min(b.y, c.y))));
+    int y1 = std::min(height - 1, (int) ceil(std::max(a.y, std::max(b.y, c.y))));
+
+    if (x0 > x1 || y0 > y1)
+    {
+        return;
+    }
+
+    glm::vec3 v0[3] = { a, b, c };
+    glm::vec3 v1[3] = { b, c, a };
+
+    float ea[3], eb[3], ec[3];
+
+    for (int e = 0; e < 3; e++)
+    {
+        ea[e] = v0[e].y - v1[e].y;
+        eb[e] = v1[e].x - v0[e].x;
+        ec[e] = -(ea[e] * v0[e].x + eb[e] * v0[e].y);
+    }
+
+    float *buffer = &max_mips[0][0];
+
+    // rows are scanned 4 pixels at a time from a 4 aligned start
+    x0 &= ~3;
+
+    for (int y = y0; y <= y1; y++)
+    {
+        float py = y + 0.5f;
+        float *row = buffer + y * width;
+
+        int x = x0;
+
+#ifdef __SSE__
+        __m128 offset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 zero   = _mm_setzero_ps();
+        __m128 vdepth = _mm_set1_ps(depth);
+
+        __m128 A0 = _mm_set1_ps(ea[0]), R0 = _mm_set1_ps(eb[0] * py + ec[0]);
+        __m128 A1 = _mm_set1_ps(ea[1]), R1 = _mm_set1_ps(eb[1] * py + ec[1]);
+        __m128 A2 = _mm_set1_ps(ea[2]), R2 = _mm_set1_ps(eb[2] * py + ec[2]);
+
+        for (; x <= x1; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float) x), offset);
+
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(A0, px), R0), zero),
+                                       _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(A1, px), R1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(A2, px), R2), zero));
+
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 closer = _mm_min_ps(old, vdepth);
+
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+        }
+#endif
+
+        for (; x <= x1; x++)
+        {
+            float px = x + 0.5f;
+
+            if (   ea[0] * px + eb[0] * py + ec[0] >= 0
+                && ea[1] * px + eb[1] * py + ec[1] >= 0
+                && ea[2] * px + eb[2] * py + ec[2] >= 0)
+            {
+                row[x] = std::min(row[x], depth);
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::build_mips()
+{
+    min_mips[0] = max_mips[0];
+
+    for (int level = 1; level < max_mips.size(); level++)
+    {
+        int w  = level_width(level);
+        int h  = level_height(level);
+        int pw = level_width(level - 1);
+
+        const float *src_max = &max_mips[level - 1][0];
+        const float *src_min = &min_mips[level - 1][0];
+        float *dst_max = &max_mips[level][0];
+        float *dst_min = &min_mips[level][0];
+
+        for (int y = 0; y < h; y++)
+        {
+            const float *max0 = src_max + (2 * y) * pw;
+            const float *max1 = max0 + pw;
+            const float *min0 = src_min + (2 * y) * pw;
+            const float *min1 = min0 + pw;
+
+            int x = 0;
+
+#ifdef __SSE__
+            // 8 source texels per row become 4, split even and odd columns
+            for (; x + 4 <= w; x += 4)
+            {
+                __m128 a0 = _mm_loadu_ps(max0 + 2 * x), b0 = _mm_loadu_ps(max0 + 2 * x + 4);
+                __m128 a1 = _mm_loadu_ps(max1 + 2 * x), b1 = _mm_loadu_ps(max1 + 2 * x + 4);
+
+                __m128 hi = _mm_max_ps(_mm_max_ps(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                  _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1))),
+                                       _mm_max_ps(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                  _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+
+                a0 = _mm_loadu_ps(min0 + 2 * x), b0 = _mm_loadu_ps(min0 + 2 * x + 4);
+                a1 = _mm_loadu_ps(min1 + 2 * x), b1 = _mm_loadu_ps(min1 + 2 * x + 4);
+
+                __m128 lo = _mm_min_ps(_mm_min_ps(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                  _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1))),
+                                       _mm_min_ps(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                  _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+
+                _mm_storeu_ps(dst_max + y * w + x, hi);
+                _mm_storeu_ps(dst_min + y * w + x, lo);
+            }
+#endif
+
+            for (; x < w; x++)
+            {
+                dst_max[y * w + x] = std::max(std::max(max0[2 * x], max0[2 * x + 1]),
+                                              std::max(max1[2 * x], max1[2 * x + 1]));
+                dst_min[y * w + x] = std::min(std::min(min0[2 * x], min0[2 * x + 1]),
+                                              std::min(min1[2 * x], min1[2 * x + 1]));
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::occluded(const glm::mat4 &pv, const glm::vec3 &min, const glm::vec3 &max) const
+{
+    float minx = FLT_MAX, maxx = -FLT_MAX;
+    float miny = FLT_MAX, maxy = -FLT_MAX;
+    float nearest = FLT_MAX, farthest = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? max.x : min.x,
+                         (i & 2) ? max.y : min.y,
+                         (i & 4) ? max.z : min.z);
+
+        glm::vec4 clip = pv * glm::vec4(corner, 1);
+
+        if (clip.w < NEAR_W)
+        {
+            return false;
+        }
+
+        float sx = (clip.x / clip.w * 0.5f + 0.5f) * width;
+        float sy = (clip.y / clip.w * 0.5f + 0.5f) * height;
+
+        minx = std::min(minx, sx);
+        maxx = std::max(maxx, sx);
+        miny = std::min(miny, sy);
+        maxy = std::max(maxy, sy);
+
+        nearest  = std::min(nearest, clip.w);
+        farthest = std::max(farthest, clip.w);
+    }
+
+    if (maxx < 0 || minx >= width || maxy < 0 || miny >= height)
+    {
+        return false;
+    }
+
+    int x0 = std::max(0, (int) minx);
+    int x1 = std::min(width - 1, (int) maxx);
+    int y0 = std::max(0, (int) miny);
+    int y1 = std::min(height - 1, (int) maxy);
+
+    // coarsest level where the rectangle spans at most 2 x 2 texels
+    int level = 0;
+
+    while (level + 1 < max_mips.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+    {
+        level++;
+    }
+
+    int w = level_width(level);
+
+    float occluder_far  = 0;
+    float occluder_near = FLT_MAX;
+
+    for (int y = y0 >> level; y <= (y1 >> level); y++)
+    {
+        for (int x = x0 >> level; x <= (x1 >> level); x++)
+        {
+            occluder_far  = std::max(occluder_far, max_mips[level][y * w + x]);
+            occluder_near = std::min(occluder_near, min_mips[level][y * w + x]);
+        }
+    }
+
+    // in front of everything drawn there
+    if (farthest < occluder_near)
+    {
+        return false;
+    }
+
+    return nearest > occluder_far;
+}
@@ -0,0 +1,54 @@
+#ifndef OCCLUSION_H_
+#define OCCLUSION_H_
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+using namespace std;
+
+/*
+    Small software depth buffer for occluder proxies. Depth is the clip w,
+    the distance along the view direction, and every triangle writes its
+    farthest vertex so the buffer never claims more than the proxy covers.
+*/
+
+class OcclusionBuffer
+{
+public:
+    const int width;
+    const int height;
+
+    // level 0 is the full buffer, each level halves both sides
+    vector<vector<float> > max_mips;
+    vector<vector<float> > min_mips;
+
+    OcclusionBuffer(int width, int height);
+    ~OcclusionBuffer();
+
+    void clear();
+
+    // triangle list, three world space vertices per triangle
+    void rasterize(const glm::mat4 &pv, const vector<glm::vec3> &triangles);
+
+    void build_mips();
+
+    // true when the box is behind the occluders everywhere it covers
+    bool occluded(const glm::mat4 &pv, const glm::vec3 &min, const glm::vec3 &max) const;
+
+private:
+
+    void triangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, float depth);
+
+    int level_width(int level) const
+    {
+        return width >> level;
+    }
+
+    int level_height(int level) const
+    {
+        return height >> level;
+    }
+};
+
+#endif
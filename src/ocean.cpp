@@ -0,0 +1,306 @@
+#include "ocean.h"
+#include "worker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define GRAVITY 9.81f
+#define TWO_PI  6.28318530f
+
+Ocean::Ocean(float _x, float _y, float _z, int _size, float _length, int _tiles, float _clearance)
+    : size(_size),
+      length(_length)
+{
+    xPos = _x;
+    yPos = _y;
+    zPos = _z;
+
+    tiles     = _tiles;
+    clearance = _clearance;
+    time      = 0;
+
+    height.assign(size * size, 0.0f);
+    re.assign(size * size, 0.0f);
+    im.assign(size * size, 0.0f);
+
+    // bit reversal and inverse twiddles for the radix-2 passes
+    int bits = 0;
+    while ((1 << bits) < size)
+    {
+        bits++;
+    }
+
+    reverse.resize(size);
+    for (int i = 0; i < size; i++)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; b++)
+        {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        reverse[i] = r;
+    }
+
+    twiddle_re.resize(size / 2);
+    twiddle_im.resize(size / 2);
+    for (int k = 0; k < size / 2; k++)
+    {
+        twiddle_re[k] = cos(TWO_PI * k / size);
+        twiddle_im[k] = sin(TWO_PI * k / size);
+    }
+
+    spectrum(1.2f, 1.0f, 0.6f, 12.0f);
+
+    for (int tz = -tiles / 2; tz < tiles - tiles / 2; tz++)
+    {
+        for (int tx = -tiles / 2; tx < tiles - tiles / 2; tx++)
+        {
+            // the point of the tile nearest the centre, a tile is kept only
+            // if all of it lies outside the clearance
+            float x = min(abs(tx), abs(tx + 1)) * length;
+            float z = min(abs(tz), abs(tz + 1)) * length;
+
+            if (x * x + z * z < clearance * clearance)
+            {
+                continue;
+            }
+
+            offsets.push_back(glm::vec3(tx * length, 0, tz * length));
+        }
+    }
+}
+
+Ocean::~Ocean()
+{
+}
+
+void Ocean::spectrum(float rms_height, float wind_x, float wind_z, float wind_speed)
+{
+    int n2 = size * size;
+
+    h0_re.assign(n2, 0.0f);
+    h0_im.assign(n2, 0.0f);
+    h0c_re.assign(n2, 0.0f);
+    h0c_im.assign(n2, 0.0f);
+    omega.assign(n2, 0.0f);
+
+    float wind_len = sqrt(wind_x * wind_x + wind_z * wind_z);
+    wind_x /= wind_len;
+    wind_z /= wind_len;
+
+    // largest wave from the wind, and a cut for ripples below a cell
+    float L = wind_speed * wind_speed / GRAVITY;
+    float l = length / size;
+
+    // fixed seed, the swell looks the same on every launch
+    std::mt19937 gen(20170826);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+    double energy = 0;
+
+    for (int m = 0; m < size; m++)
+    {
+        for (int n = 0; n < size; n++)
+        {
+            int idx = m * size + n;
+
+            float kx = TWO_PI * (n - size / 2) / length;
+            float kz = TWO_PI * (m - size / 2) / length;
+            float k  = sqrt(kx * kx + kz * kz);
+
+            float xr = gauss(gen);
+            float xi = gauss(gen);
+
+            if (k < 1e-6f)
+            {
+                continue;
+            }
+
+            float kw = (kx * wind_x + kz * wind_z) / k;
+            float phillips = exp(-1.0f / (k * L * k * L)) / (k * k * k * k) * kw * kw * exp(-k * k * l * l);
+
+            h0_re[idx] = xr * sqrt(phillips / 2);
+            h0_im[idx] = xi * sqrt(phillips / 2);
+            omega[idx] = sqrt(GRAVITY * k);
+
+            energy += h0_re[idx] * h0_re[idx] + h0_im[idx] * h0_im[idx];
+        }
+    }
+
+    // the unnormalized sum has variance 2 * energy, scale to the wanted swell
+    float amplitude = energy > 0 ? rms_height / sqrt(2 * energy) : 0;
+
+    for (int idx = 0; idx < n2; idx++)
+    {
+        h0_re[idx] *= amplitude;
+        h0_im[idx] *= amplitude;
+    }
+
+    // conj(h0(-k)), pairs the waves so the heightfield comes out real
+    for (int m = 0; m < size; m++)
+    {
+        for (int n = 0; n < size; n++)
+        {
+            int mirror = ((size - m) % size) * size + (size - n) % size;
+            h0c_re[m * size + n] =  h0_re[mirror];
+            h0c_im[m * size + n] = -h0_im[mirror];
+        }
+    }
+}
+
+void Ocean::evaluate(int begin, int end)
+{
+    for (int idx = begin * size; idx < end * size; idx++)
+    {
+        float c = cos(omega[idx] * time);
+        float s = sin(omega[idx] * time);
+
+        re[idx] = (h0_re[idx] + h0c_re[idx]) * c + (h0c_im[idx] - h0_im[idx]) * s;
+        im[idx] = (h0_im[idx] + h0c_im[idx]) * c + (h0_re[idx] - h0c_re[idx]) * s;
+    }
+}
+
+/*
+    Inverse FFT down the columns [begin, end). Every butterfly combines two
+    whole rows with one twiddle, so the inner loop runs along contiguous
+    memory, 4 columns per SSE op.
+*/
+void Ocean::fft_columns(int begin, int end)
+{
+    for (int j = 0; j < size; j++)
+    {
+        int r = reverse[j];
+
+        if (r > j)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                std::swap(re[j * size + i], re[r * size + i]);
+                std::swap(im[j * size + i], im[r * size + i]);
+            }
+        }
+    }
+
+    for (int span = 2; span <= size; span *= 2)
+    {
+        int half = span / 2;
+        int step = size / span;
+
+        for (int start = 0; start < size; start += span)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                float wr = twiddle_re[k * step];
+                float wi = twiddle_im[k * step];
+
+                float *ar = &re[(start + k) * size];
+                float *ai = &im[(start + k) * size];
+                float *br = &re[(start + k + half) * size];
+                float *bi = &im[(start + k + half) * size];
+
+                int i = begin;
+
+#ifdef __SSE__
+                __m128 vwr = _mm_set1_ps(wr);
+                __m128 vwi = _mm_set1_ps(wi);
+
+                for (; i + 4 <= end; i += 4)
+                {
+                    __m128 xr = _mm_loadu_ps(br + i);
+                    __m128 xi = _mm_loadu_ps(bi + i);
+                    __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, vwr), _mm_mul_ps(xi, vwi));
+                    __m128 ti = _mm_add_ps(_mm_mul_ps(xr, vwi), _mm_mul_ps(xi, vwr));
+
+                    __m128 yr = _mm_loadu_ps(ar + i);
+                    __m128 yi = _mm_loadu_ps(ai + i);
+
+                    _mm_storeu_ps(br + i, _mm_sub_ps(yr, tr));
+                    _mm_storeu_ps(bi + i, _mm_sub_ps(yi, ti));
+                    _mm_storeu_ps(ar + i, _mm_add_ps(yr, tr));
+                    _mm_storeu_ps(ai + i, _mm_add_ps(yi, ti));
+                }
+#endif
+
+                for (; i < end; i++)
+                {
+                    float tr = br[i] * wr - bi[i] * wi;
+                    float ti = br[i] * wi + bi[i] * wr;
+
+                    br[i] = ar[i] - tr;
+                    bi[i] = ai[i] - ti;
+                    ar[i] += tr;
+                    ai[i] += ti;
+                }
+            }
+        }
+    }
+}
+
+void Ocean::transpose()
+{
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = j + 1; i < size; i++)
+        {
+            std::swap(re[j * size + i], re[i * size + j]);
+            std::swap(im[j * size + i], im[i * size + j]);
+        }
+    }
+}
+
+void Ocean::inverse_fft()
+{
+    WorkerPool &pool = WorkerPool::shared();
+    std::function<void(int, int)> columns = [this](int begin, int end) { fft_columns(begin, end); };
+
+    pool.parallel_for(size, 16, columns);
+    transpose();
+    pool.parallel_for(size, 16, columns);
+    transpose();
+}
+
+void Ocean::update(float dt)
+{
+    time += dt;
+
+    WorkerPool::shared().parallel_for(size, 8, [this](int begin, int end) { evaluate(begin, end); });
+
+    inverse_fft();
+
+    // the spectrum is centred on k = 0, undo the shift with a checkerboard sign
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            height[j * size + i] = ((i + j) & 1) ? -re[j * size + i] : re[j * size + i];
+        }
+    }
+
+    voxels.clear();
+
+    float cell = length / size;
+
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            float h = height[j * size + i];
+
+            glm::vec4 color = glm::vec4(31, 71, 136, 255) / 255.0f;
+
+            // foam on the crests
+            if (h > 1.5f)
+            {
+                color = glm::vec4(235, 246, 247, 255) / 255.0f;
+            }
+
+            // relative to the ocean's origin
+            voxels.push_back(make_voxel(glm::vec3(i * cell, h, j * cell), cell / 4, color));
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef OCEAN_H_
+#define OCEAN_H_
+
+#include "voxel.h"
+#include <vector>
+using namespace std;
+
+/*
+    Open-ocean swell from a Phillips spectrum, one inverse FFT per frame.
+    The heightmap is periodic, a single tile is repeated over the background.
+    Only that tile is turned into voxels, the scene draws it once per offset.
+*/
+
+class Ocean
+{
+public:
+    const int size;
+    const float length;
+
+    float xPos, yPos, zPos;
+
+    int tiles;
+    float clearance;
+
+    float time;
+
+    // size * size heights of one tile, row major
+    vector<float> height;
+    vector<Voxel> voxels;
+
+    // where the tile is repeated, relative to the ocean's origin; tiles
+    // reaching into the clearance around the island are left out
+    vector<glm::vec3> offsets;
+
+    Ocean(float _x, float _y, float _z, int _size, float _length, int _tiles, float _clearance);
+    ~Ocean();
+
+    void update(float dt);
+
+private:
+    vector<float> h0_re, h0_im;
+    vector<float> h0c_re, h0c_im;
+    vector<float> omega;
+
+    vector<float> re, im;
+
+    vector<int> reverse;
+    vector<float> twiddle_re, twiddle_im;
+
+    void spectrum(float amplitude, float wind_x, float wind_z, float wind_speed);
+
+    void evaluate(int begin, int end);
+
+    void fft_columns(int begin, int end);
+
+    void transpose();
+
+    void inverse_fft();
+};
+
+#endif
@@ -4,6 +4,11 @@
 
 #include "render.h"
 #include "util.h"
+#include "worker.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -11,6 +16,12 @@
 #include "camera.h"
 extern Camera *camera;
 
+// frames between reports of the time spent waiting on instance stream fences
+#define FENCE_REPORT_FRAMES 600
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -65,10 +76,25 @@ OGLRenderer::OGLRenderer()
     ukiyoeShader->addAttribute("vertex");
     ukiyoeShader->addAttribute("normal");
     ukiyoeShader->addAttribute("model_color");
-    ukiyoeShader->addAttribute("model_matrix");
+    ukiyoeShader->addAttribute("model_position");
 
     ukiyoeShader->addUniform("view_matrix");
     ukiyoeShader->addUniform("projection_matrix");
+    ukiyoeShader->addUniform("time");
+    ukiyoeShader->addUniform("spawn");
+
+    ukiyoeShader->addUniform("resident");
+    ukiyoeShader->addUniform("voxels");
+    ukiyoeShader->addUniform("visible");
+    ukiyoeShader->addUniform("first");
+    ukiyoeShader->addUniform("origin");
+    ukiyoeShader->addUniform("placement");
+
+    // buffer textures of the static path, unit 0 belongs to the background
+    ukiyoeShader->use();
+    glUniform1i(ukiyoeShader->uniform("voxels"), 1);
+    glUniform1i(ukiyoeShader->uniform("visible"), 2);
+    ukiyoeShader->disable();
 
     /* IBO */
     glGenBuffers(1, &ibo_cube_elements);
@@ -90,30 +116,94 @@ OGLRenderer::OGLRenderer()
     glVertexAttribPointer(ukiyoeShader->attribute("normal"), 3, GL_FLOAT, GL_FALSE, 0, NULL);
 
     /*
-        Instance Rendering Data Buffer
+        Instance Rendering Data Buffer, streamed through RING_FRAMES
+        persistently mapped regions where buffer storage is available
      */
+    persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    ring_frame = 0;
+    static_version = 0;
+
+    for (int r = 0; r < RING_FRAMES; r++)
+    {
+        fences[r] = 0;
+        region_version[r] = ~0u;
+    }
+
+    fence_waits = 0;
+    fence_wait_ms = 0;
+    fence_wait_max = 0;
+    fence_frames = 0;
 
     /* VBO */
-    glGenBuffers(1, &colors_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, colors_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4) * 512 * 512, NULL, GL_DYNAMIC_DRAW);
+    colors_buffer = createStream(GL_ARRAY_BUFFER, sizeof(GLuint) * MAX_INSTANCES, &colors_mapped);
     glEnableVertexAttribArray(ukiyoeShader->attribute("model_color"));
-    glVertexAttribPointer(ukiyoeShader->attribute("model_color"), 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glVertexAttribPointer(ukiyoeShader->attribute("model_color"), 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, NULL);
     glVertexAttribDivisor(ukiyoeShader->attribute("model_color"), 1);
 
-    /* VBO */
-    glGenBuffers(1, &models_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, models_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * 512 * 512, NULL, GL_DYNAMIC_DRAW);
+    /* VBO, the shader builds the matrix from position and scale */
+    positions_buffer = createStream(GL_ARRAY_BUFFER, sizeof(glm::vec4) * MAX_INSTANCES, &positions_mapped);
+    glEnableVertexAttribArray(ukiyoeShader->attribute("model_position"));
+    glVertexAttribPointer(ukiyoeShader->attribute("model_position"), 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glVertexAttribDivisor(ukiyoeShader->attribute("model_position"), 1);
 
-    // Loop over each column of the matrix...
-    for (int i = 0; i < 4; i++)
+    instance_count = 0;
+    start = std::chrono::steady_clock::now();
+
+    /*
+        Static instances read everything from buffer textures, their VAO
+        only needs the cube
+    */
+    glGenVertexArrays(1, &residentVao);
+    glBindVertexArray(residentVao);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube_elements);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertices_buffer);
+    glEnableVertexAttribArray(ukiyoeShader->attribute("vertex"));
+    glVertexAttribPointer(ukiyoeShader->attribute("vertex"), 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    glBindBuffer(GL_ARRAY_BUFFER, normals_buffer);
+    glEnableVertexAttribArray(ukiyoeShader->attribute("normal"));
+    glVertexAttribPointer(ukiyoeShader->attribute("normal"), 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    visible_buffer = createStream(GL_TEXTURE_BUFFER, sizeof(GLuint) * MAX_INSTANCES, &visible_mapped);
+
+    // spans every region, the draws add the region to their start
+    glGenTextures(1, &visible_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, visible_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, visible_buffer);
+
+    if (persistent && (colors_mapped == NULL || positions_mapped == NULL || visible_mapped == NULL))
     {
-        glEnableVertexAttribArray(ukiyoeShader->attribute("model_matrix") + i);
-        glVertexAttribPointer(ukiyoeShader->attribute("model_matrix") + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
-        glVertexAttribDivisor(ukiyoeShader->attribute("model_matrix") + i, 1);
+        printf("instance streams: persistent mapping failed, mapping every frame\n");
+        persistent = false;
     }
 
+    printf("instance streams: %s\n", persistent ? "persistently mapped, " STRINGIFY(RING_FRAMES) " fenced regions"
+                                                 : "mapped and orphaned every frame");
+
+    /*
+        Init Mesh Shader, shares the fragment stage with the instances
+    */
+    Shader mesh_vertexShader(GL_VERTEX_SHADER);
+    mesh_vertexShader.loadFromFile("mesh_vertex.glsl");
+    mesh_vertexShader.compile();
+
+    meshShader = new ShaderProgram();
+    meshShader->attachShader(mesh_vertexShader);
+    meshShader->attachShader(fragmentShader);
+    meshShader->linkProgram();
+
+    meshShader->addAttribute("vertex");
+    meshShader->addAttribute("normal");
+    meshShader->addAttribute("vertex_color");
+
+    meshShader->addUniform("view_matrix");
+    meshShader->addUniform("projection_matrix");
+    meshShader->addUniform("model_matrix");
+    meshShader->addUniform("time");
+    meshShader->addUniform("spawn");
+
     /* VAO */
     glGenVertexArrays(1, &bgVao);
     glBindVertexArray(bgVao);
@@ -179,7 +269,81 @@ OGLRenderer::~OGLRenderer()
 {
 }
 
-void OGLRenderer::update(std::vector<Voxel *> node)
+/*
+    Storage for one instance stream. With buffer storage it holds
+    RING_FRAMES regions and stays mapped for good, otherwise it is a
+    single region mapped every frame.
+*/
+GLuint OGLRenderer::createStream(GLenum target, GLsizeiptr region, void **mapped)
+{
+    GLuint buffer;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+
+    *mapped = NULL;
+
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(target, region * RING_FRAMES, NULL, flags);
+        *mapped = glMapBufferRange(target, 0, region * RING_FRAMES, flags);
+    }
+    else
+    {
+        glBufferData(target, region, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    return buffer;
+}
+
+// blocks until the GPU has drawn from the region, the time spent is reported
+void OGLRenderer::waitRegion(int region)
+{
+    if (fences[region] != 0)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+
+        // not signalled on the first poll, however the spin ends it was a stall
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            fence_waits++;
+        }
+
+        while (status == GL_TIMEOUT_EXPIRED)
+        {
+            status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        fence_wait_ms += ms;
+        fence_wait_max = std::max(fence_wait_max, ms);
+
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+
+    if (++fence_frames == FENCE_REPORT_FRAMES)
+    {
+        printf("instance streams: stalled on %d of %d frames, %.3f ms per frame, %.3f ms at most\n",
+               fence_waits, fence_frames, fence_wait_ms / fence_frames, fence_wait_max);
+
+        fence_waits = 0;
+        fence_wait_ms = 0;
+        fence_wait_max = 0;
+        fence_frames = 0;
+    }
+}
+
+float OGLRenderer::seconds() const
+{
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+void OGLRenderer::update(std::vector<CullBatch> &batches, int first, int static_count, int dynamic_count)
 {
     ukiyoeShader->use();
 
@@ -188,41 +352,277 @@ void OGLRenderer::update(std::vector<Voxel *> node)
     */
     glUniformMatrix4fv(ukiyoeShader->uniform("view_matrix"), 1, GL_FALSE, glm::value_ptr(camera -> view));
     glUniformMatrix4fv(ukiyoeShader->uniform("projection_matrix"), 1, GL_FALSE, glm::value_ptr(camera -> projection));
+    glUniform1f(ukiyoeShader->uniform("time"), seconds());
+
+    int static_end  = std::min(static_count, MAX_INSTANCES);
+    int dynamic_end = std::min(dynamic_count, MAX_INSTANCES);
 
     /*
-        Update Instance model matrix
+        The region this frame writes. With persistent streams the GPU may
+        still read it from RING_FRAMES frames ago, so wait for that fence.
     */
-    glBindBuffer(GL_ARRAY_BUFFER, models_buffer);
-    glm::mat4 *matrices = (glm::mat4 *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    if (persistent)
+    {
+        ring_frame = (ring_frame + 1) % RING_FRAMES;
+        waitRegion(ring_frame);
+    }
+
+    // a region keeps the static indices it was given until the static batches change
+    if (first == 0)
+    {
+        static_version++;
+    }
+
+    bool write_static = region_version[ring_frame] != static_version;
+    region_version[ring_frame] = static_version;
+
+    GLuint *indices = NULL;
+    glm::vec4 *positions = NULL;
+    GLuint *tints = NULL;
+
+    if (persistent)
+    {
+        indices   = (GLuint *)visible_mapped + ring_frame * MAX_INSTANCES;
+        positions = (glm::vec4 *)positions_mapped + ring_frame * MAX_INSTANCES;
+        tints     = (GLuint *)colors_mapped + ring_frame * MAX_INSTANCES;
+    }
+    else
+    {
+        // orphaned on every map, the driver hands out fresh storage instead of stalling
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+        if (write_static && static_end > 0)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, visible_buffer);
+            indices = (GLuint *)glMapBufferRange(GL_TEXTURE_BUFFER, 0, sizeof(GLuint) * static_end, access);
+        }
+
+        if (dynamic_end > 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, positions_buffer);
+            positions = (glm::vec4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(glm::vec4) * dynamic_end, access);
+
+            glBindBuffer(GL_ARRAY_BUFFER, colors_buffer);
+            tints = (GLuint *)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(GLuint) * dynamic_end, access);
+        }
+    }
 
-    for (int n = 0; n < node.size(); n++)
+    // a stale region needs the reused static batches too
+    int from = write_static ? 0 : first;
+
+    WorkerPool::shared().parallel_for(batches.size() - from, 1, [&](int job_begin, int job_end)
+    {
+        for (int b = from + job_begin; b < from + job_end; b++)
+        {
+            CullBatch &batch = batches[b];
+            int last = std::max(0, std::min((int) batch.visible.size(), MAX_INSTANCES - batch.offset));
+
+            if (batch.resident >= 0)
+            {
+                if (write_static && indices != NULL)
+                {
+                    std::copy(batch.visible.begin(), batch.visible.begin() + last, indices + batch.offset);
+                }
+
+                continue;
+            }
+
+            if (positions == NULL || tints == NULL)
+            {
+                continue;
+            }
+
+            for (int k = 0; k < last; k++)
+            {
+                int n = batch.offset + k;
+                const Voxel &tmp = (*batch.voxels)[batch.visible[k]];
+
+                /*
+                    Update Instance position and scale
+                */
+                positions[n] = glm::vec4(batch.placement.apply(voxel_pos(tmp, batch.origin)), voxel_scale(tmp));
+
+                /*
+                    Update Instance model color, the Voxel's bytes as they are
+                */
+                memcpy(&tints[n], tmp.color, sizeof(GLuint));
+            }
+        }
+    });
+
+    if (!persistent)
     {
-        Voxel *tmp = node[n];
-        matrices[n] = glm::translate(glm::mat4(1.0f), tmp->pos);
-        matrices[n] = glm::scale(matrices[n], glm::vec3(tmp->scale));
+        if (indices != NULL)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, visible_buffer);
+            glUnmapBuffer(GL_TEXTURE_BUFFER);
+        }
+
+        if (dynamic_end > 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, colors_buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+
+            glBindBuffer(GL_ARRAY_BUFFER, positions_buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
     }
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    instance_count = (positions != NULL && tints != NULL) ? dynamic_end : 0;
 
     /*
-        Update Instance model color
+        Neighbouring batches of one node and placement become a single draw
     */
-    glBindBuffer(GL_ARRAY_BUFFER, colors_buffer);
-    glm::vec4 *colors = (glm::vec4 *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    for (int n = 0; n < node.size(); n++)
+    resident_draws.clear();
+
+    for (int b = 0; b < batches.size(); b++)
     {
-        Voxel *tmp = node[n];
-        if (tmp->color.a < 1.0)
+        const CullBatch &batch = batches[b];
+        int last = std::max(0, std::min((int) batch.visible.size(), MAX_INSTANCES - batch.offset));
+
+        if (batch.resident < 0 || last == 0)
+        {
+            continue;
+        }
+
+        if (!resident_draws.empty())
         {
-            tmp->color.a = tmp->color.a + 0.01;
+            ResidentDraw &draw = resident_draws.back();
+
+            if (draw.resident == batch.resident && draw.placement == batch.placement.model()
+                && draw.first + draw.count == batch.offset)
+            {
+                draw.count += last;
+                continue;
+            }
         }
-        colors[n] = tmp->color;
+
+        ResidentDraw draw;
+        draw.resident  = batch.resident;
+        draw.origin    = batch.origin;
+        draw.placement = batch.placement.model();
+        draw.first     = batch.offset;
+        draw.count     = last;
+
+        resident_draws.push_back(draw);
     }
-    glUnmapBuffer(GL_ARRAY_BUFFER);
 
     ukiyoeShader -> disable();
+
+    /*
+        Static meshes only need the camera and the clock
+    */
+    meshShader->use();
+
+    glUniformMatrix4fv(meshShader->uniform("view_matrix"), 1, GL_FALSE, glm::value_ptr(camera -> view));
+    glUniformMatrix4fv(meshShader->uniform("projection_matrix"), 1, GL_FALSE, glm::value_ptr(camera -> projection));
+    glUniform1f(meshShader->uniform("time"), seconds());
+
+    meshShader -> disable();
+}
+
+int OGLRenderer::addMesh(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    StaticMesh mesh;
+    mesh.count   = indices.size();
+    mesh.spawn   = seconds();
+
+    /* VAO */
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    /* IBO */
+    glGenBuffers(1, &mesh.elements_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elements_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+
+    /* VBO */
+    glGenBuffers(1, &mesh.vertices_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertices_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(MeshVertex) * vertices.size(), vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(meshShader->attribute("vertex"));
+    glVertexAttribPointer(meshShader->attribute("vertex"), 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, pos));
+
+    glEnableVertexAttribArray(meshShader->attribute("normal"));
+    glVertexAttribPointer(meshShader->attribute("normal"), 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, normal));
+
+    glEnableVertexAttribArray(meshShader->attribute("vertex_color"));
+    glVertexAttribPointer(meshShader->attribute("vertex_color"), 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, color));
+
+    glBindVertexArray(0);
+
+    meshes.push_back(mesh);
+
+    return meshes.size() - 1;
+}
+
+void OGLRenderer::beginMeshes()
+{
+    mesh_draws.clear();
+}
+
+void OGLRenderer::drawMesh(int id, const glm::mat4 &model)
+{
+    mesh_draws.push_back(std::make_pair(id, model));
 }
 
-void OGLRenderer::render(std::vector<Voxel *> node)
+// the shader reads a Voxel as three uints, x y | z scale | rgba
+static_assert(sizeof(Voxel) == 12, "resident voxels are fetched as GL_RGB32UI texels");
+
+int OGLRenderer::addResident(const std::vector<Voxel> &voxels)
+{
+    int id = 0;
+
+    while (id < residents.size() && residents[id].buffer != 0)
+    {
+        id++;
+    }
+
+    if (id == residents.size())
+    {
+        residents.push_back(ResidentVoxels());
+    }
+
+    ResidentVoxels &resident = residents[id];
+    resident.count = voxels.size();
+    resident.spawn = seconds();
+
+    glGenBuffers(1, &resident.buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, resident.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(Voxel) * voxels.size(), voxels.empty() ? NULL : &voxels[0], GL_STATIC_DRAW);
+
+    glGenTextures(1, &resident.texture);
+    glBindTexture(GL_TEXTURE_BUFFER, resident.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32UI, resident.buffer);
+
+    return id;
+}
+
+void OGLRenderer::removeResident(int id)
+{
+    glDeleteTextures(1, &residents[id].texture);
+    glDeleteBuffers(1, &residents[id].buffer);
+
+    residents[id].buffer  = 0;
+    residents[id].texture = 0;
+    residents[id].count   = 0;
+}
+
+void OGLRenderer::clearMeshes()
+{
+    for (int i = 0; i < meshes.size(); i++)
+    {
+        glDeleteBuffers(1, &meshes[i].vertices_buffer);
+        glDeleteBuffers(1, &meshes[i].elements_buffer);
+        glDeleteVertexArrays(1, &meshes[i].vao);
+    }
+
+    meshes.clear();
+    mesh_draws.clear();
+}
+
+void OGLRenderer::render()
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -233,7 +633,59 @@ void OGLRenderer::render(std::vector<Voxel *> node)
 
     glClear(GL_DEPTH_BUFFER_BIT);
     ukiyoeShader -> use();
+
+    // dynamic instances from the attributes, pointed at this frame's region
+    glUniform1i(ukiyoeShader->uniform("resident"), 0);
     glBindVertexArray(vao);
-    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, node.size());
+
+    glBindBuffer(GL_ARRAY_BUFFER, colors_buffer);
+    glVertexAttribPointer(ukiyoeShader->attribute("model_color"), 4, GL_UNSIGNED_BYTE, GL_TRUE, 0,
+                          (void *)(sizeof(GLuint) * MAX_INSTANCES * ring_frame));
+
+    glBindBuffer(GL_ARRAY_BUFFER, positions_buffer);
+    glVertexAttribPointer(ukiyoeShader->attribute("model_position"), 4, GL_FLOAT, GL_FALSE, 0,
+                          (void *)(sizeof(glm::vec4) * MAX_INSTANCES * ring_frame));
+
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, instance_count);
+
+    // static instances, one draw per node and placement
+    glUniform1i(ukiyoeShader->uniform("resident"), 1);
+    glBindVertexArray(residentVao);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, visible_texture);
+    glActiveTexture(GL_TEXTURE1);
+
+    for (int i = 0; i < resident_draws.size(); i++)
+    {
+        const ResidentDraw &draw = resident_draws[i];
+
+        glBindTexture(GL_TEXTURE_BUFFER, residents[draw.resident].texture);
+        glUniform1f(ukiyoeShader->uniform("spawn"), residents[draw.resident].spawn);
+        glUniform1i(ukiyoeShader->uniform("first"), MAX_INSTANCES * ring_frame + draw.first);
+        glUniform3fv(ukiyoeShader->uniform("origin"), 1, glm::value_ptr(draw.origin));
+        glUniformMatrix4fv(ukiyoeShader->uniform("placement"), 1, GL_FALSE, glm::value_ptr(draw.placement));
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, draw.count);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
     ukiyoeShader -> disable();
-}
\ No newline at end of file
+
+    // the region is free again once the GPU is past these draws
+    if (persistent)
+    {
+        fences[ring_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    meshShader -> use();
+    for (int i = 0; i < mesh_draws.size(); i++)
+    {
+        const StaticMesh &mesh = meshes[mesh_draws[i].first];
+
+        glUniformMatrix4fv(meshShader->uniform("model_matrix"), 1, GL_FALSE, glm::value_ptr(mesh_draws[i].second));
+        glUniform1f(meshShader->uniform("spawn"), mesh.spawn);
+        glBindVertexArray(mesh.vao);
+        glDrawElements(GL_TRIANGLES, mesh.count, GL_UNSIGNED_INT, 0);
+    }
+    meshShader -> disable();
+}
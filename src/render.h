@@ -6,8 +6,59 @@
 #include "shader.hpp"
 
 #include "voxel.h"
+#include "cull.h"
+#include "mesher.h"
+#include <chrono>
+#include <utility>
 #include <vector>
 
+#define MAX_INSTANCES (512 * 512)
+
+// frames in flight for the streamed instance data
+#define RING_FRAMES 3
+
+/*
+    Merged geometry of one static node, uploaded once
+*/
+struct StaticMesh
+{
+    GLuint vao;
+    GLuint vertices_buffer;
+    GLuint elements_buffer;
+
+    int count;
+
+    // renderer clock when it was uploaded, the whole node fades in from there
+    float spawn;
+};
+
+/*
+    Voxels of one static node, resident on the GPU as packed 12 byte
+    Voxels behind a buffer texture. buffer is 0 for a free slot.
+*/
+struct ResidentVoxels
+{
+    GLuint buffer;
+    GLuint texture;
+    int count;
+
+    // renderer clock when it was uploaded, the shader fades the voxels in from there
+    float spawn;
+};
+
+/*
+    One instanced draw of resident voxels, a run of the visible index list
+*/
+struct ResidentDraw
+{
+    int resident;
+    glm::vec3 origin;
+    glm::mat4 placement;
+
+    int first;
+    int count;
+};
+
 class OGLRenderer
 {
     ShaderProgram *ukiyoeShader;
@@ -19,10 +70,59 @@ class OGLRenderer
     GLuint normals_buffer;
 
     /*
-        Per Instance
+        Per Instance, dynamic nodes only: vec4(position, scale) and RGBA8
     */
-    GLuint models_buffer;
+    GLuint positions_buffer;
     GLuint colors_buffer;
+    int instance_count;
+
+    /*
+        Instance streams. Persistently mapped, each buffer holds RING_FRAMES
+        regions and the frame writing one waits on the fence of its last use.
+    */
+    bool persistent;
+    int ring_frame;
+    GLsync fences[RING_FRAMES];
+
+    void *positions_mapped;
+    void *colors_mapped;
+    void *visible_mapped;
+
+    // static indices only go to regions that have not seen the current static batches
+    unsigned int static_version;
+    unsigned int region_version[RING_FRAMES];
+
+    // frames that had to wait on their region since the last report
+    int fence_waits;
+    int fence_frames;
+    double fence_wait_ms;
+    double fence_wait_max;
+
+    GLuint createStream(GLenum target, GLsizeiptr region, void **mapped);
+    void waitRegion(int region);
+
+    /*
+        Static nodes, uploaded once, and the indices of their visible voxels
+    */
+    GLuint residentVao;
+    std::vector<ResidentVoxels> residents;
+
+    GLuint visible_buffer;
+    GLuint visible_texture;
+    std::vector<ResidentDraw> resident_draws;
+
+    /*
+        Static meshes
+    */
+    ShaderProgram *meshShader;
+    std::vector<StaticMesh> meshes;
+
+    // this frame's copies, a mesh and the model matrix of one placement
+    std::vector<std::pair<int, glm::mat4> > mesh_draws;
+
+    // seconds since the renderer started, drives the fade-in in the shaders
+    std::chrono::steady_clock::time_point start;
+    float seconds() const;
 
     // BG
     ShaderProgram *bgShader;
@@ -35,8 +135,22 @@ public:
     OGLRenderer();
     ~OGLRenderer();
 
-    void update(std::vector<Voxel *> node);
-    void render(std::vector<Voxel *> node);
+    // uploads batches [first, end), the static ones before them only go to regions that missed them;
+    // static batches index the visible list, dynamic ones the instance buffers
+    void update(std::vector<CullBatch> &batches, int first, int static_count, int dynamic_count);
+    void render();
+
+    // static voxels, returns the id of their resident copy
+    int addResident(const std::vector<Voxel> &voxels);
+    void removeResident(int id);
+
+    // returns the id of the new mesh
+    int addMesh(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices);
+
+    // the scene queues the visible copies of its meshes every frame
+    void beginMeshes();
+    void drawMesh(int id, const glm::mat4 &model);
+    void clearMeshes();
 };
 
 #endif
\ No newline at end of file
@@ -1,13 +1,33 @@
 #include "sakura.h"
 
-Sakura::Sakura(float _x, float _y, float _z, int _t)
+#include <cmath>
+
+// two voxels closer than this are the same, squared
+#define EXIST_DIST2 1.415f
+#define EXIST_CELL  1.19f
+
+static uint64_t cell_key(int x, int y, int z)
+{
+    return ((uint64_t) (x & 0x1fffff) << 42) | ((uint64_t) (y & 0x1fffff) << 21) | (uint64_t) (z & 0x1fffff);
+}
+
+Sakura::Sakura(float _x, float _y, float _z, int _t, unsigned int seed)
+{
+    generate(_x, _y, _z, _t, seed);
+}
+
+void Sakura::generate(float _x, float _y, float _z, int _t, unsigned int seed)
 {
     xPos = _x;
     yPos = _y;
     zPos = _z;
     type = _t;
 
+    rng.seed(seed);
+
+    // clear keeps the capacity of the last tree
     voxels.clear();
+    grid.clear();
     branch(glm::vec3(0, 0, 0), 60.0f, 30.0f);
 }
 
@@ -17,40 +37,70 @@ Sakura::~Sakura()
 
 bool Sakura::exist(float x, float y, float z)
 {
-    for (int i = 0; i < voxels.size(); ++i)
-    {
-        float dist = (voxels[i].pos.x - x) * (voxels[i].pos.x - x) +
-                     (voxels[i].pos.y - y) * (voxels[i].pos.y - y) +
-                     (voxels[i].pos.z - z) * (voxels[i].pos.z - z);
+    int cx = floor(x / EXIST_CELL);
+    int cy = floor(y / EXIST_CELL);
+    int cz = floor(z / EXIST_CELL);
 
-        if (dist < 1.415)
+    // the radius fits in a cell, only the 27 around can hold a match
+    for (int dz = -1; dz <= 1; ++dz)
+    {
+        for (int dy = -1; dy <= 1; ++dy)
         {
-            return true;
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                unordered_map<uint64_t, vector<int> >::const_iterator cell = grid.find(cell_key(cx + dx, cy + dy, cz + dz));
+
+                if (cell == grid.end())
+                {
+                    continue;
+                }
+
+                for (int k = 0; k < cell->second.size(); ++k)
+                {
+                    glm::vec3 p = voxel_pos(voxels[cell->second[k]], glm::vec3(0.0f));
+
+                    float dist = (p.x - x) * (p.x - x) +
+                                 (p.y - y) * (p.y - y) +
+                                 (p.z - z) * (p.z - z);
+
+                    if (dist < EXIST_DIST2)
+                    {
+                        return true;
+                    }
+                }
+            }
         }
     }
 
     return false;
 }
 
+void Sakura::insert(const Voxel &voxel)
+{
+    glm::vec3 p = voxel_pos(voxel, glm::vec3(0.0f));
+
+    int cx = floor(p.x / EXIST_CELL);
+    int cy = floor(p.y / EXIST_CELL);
+    int cz = floor(p.z / EXIST_CELL);
+
+    grid[cell_key(cx, cy, cz)].push_back(voxels.size());
+    voxels.push_back(voxel);
+}
+
 void Sakura::branch(glm::vec3 pos, float _angel, float _size)
 {
     int bHeight = cos(_angel * 3.14 / 180) * _size;
-    int offset = rand() % 360;
+    int offset = rng() % 360;
 
     for (int i = 0; i <= bHeight; i++)
     {
         int x = sin(offset * 3.14 / 180) * i;
         int z = cos(offset * 3.14 / 180) * i;
 
-        Voxel tmp;
-        tmp.scale = 0.3;
-
-        tmp.pos = glm::vec3(xPos + x + pos.x, yPos + i + pos.y, zPos + z + pos.z);
-        tmp.color = glm::vec4(103, 36, 34, 0) / 255.0f;
-
-        if (!Sakura::exist(xPos + x + pos.x, yPos + i + pos.y, zPos + z + pos.z))
+        // positions are relative to the tree's origin
+        if (!Sakura::exist(x + pos.x, i + pos.y, z + pos.z))
         {
-            voxels.push_back(tmp);
+            insert(make_voxel(glm::vec3(x + pos.x, i + pos.y, z + pos.z), 0.3, glm::vec4(103, 36, 34, 255) / 255.0f));
         }
     }
 
@@ -61,7 +111,7 @@ void Sakura::branch(glm::vec3 pos, float _angel, float _size)
     if (_size >= 4)
     {
         float d;
-        d = (rand() % 10) / 10 - 0.5;
+        d = (rng() % 10) / 10 - 0.5;
         d = _angel + d * _angel;
         branch(tpos, 45.0f, bHeight);
         branch(tpos, 60.0f, bHeight);
@@ -71,26 +121,24 @@ void Sakura::branch(glm::vec3 pos, float _angel, float _size)
     {
         for (int i = 0; i < 16; ++i)
         {
-            int a = rand() % 360;
+            int a = rng() % 360;
             int x = sin(a * 3.14 / 180) * 8;
-            int y = rand() % 16 - 2;
+            int y = rng() % 16 - 2;
             int z = cos(a * 3.14 / 180) * 8;
 
-            Voxel tmp;
-            tmp.scale = 0.5;
-            tmp.pos = glm::vec3(xPos + x + tpos.x, yPos + i + tpos.y, zPos + z + tpos.z);
+            glm::vec4 color(0.0f);
 
             if (type == 0) {
-                tmp.color = glm::vec4(219, 90, 107, 0) / 255.0f;
+                color = glm::vec4(219, 90, 107, 255) / 255.0f;
             }
 
             if (type == 1) {
-                tmp.color = glm::vec4(243, 243, 242, 0) / 255.0f;
+                color = glm::vec4(243, 243, 242, 255) / 255.0f;
             }
 
-            if (!Sakura::exist(xPos + x + tpos.x, yPos + i + tpos.y, zPos + z + tpos.z))
+            if (!Sakura::exist(x + tpos.x, i + tpos.y, z + tpos.z))
             {
-                voxels.push_back(tmp);
+                insert(make_voxel(glm::vec3(x + tpos.x, i + tpos.y, z + tpos.z), 0.5, color));
             }
         }
     }
@@ -2,6 +2,9 @@
 #define SAKURA_H_
 
 #include "voxel.h"
+#include <random>
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -12,11 +15,23 @@ public:
     float xPos, yPos, zPos;
     vector<Voxel> voxels;
 
-    Sakura(float _x, float _y, float _z, int _t);
+    // the same seed grows the same tree
+    Sakura(float _x, float _y, float _z, int _t, unsigned int seed);
     ~Sakura();
 
+    // regrows in place, reusing the voxel storage
+    void generate(float _x, float _y, float _z, int _t, unsigned int seed);
+
     bool exist(float x, float y, float z);
     void branch(glm::vec3 pos, float _angel, float _size);
+
+private:
+    std::mt19937 rng;
+
+    // voxel indices bucketed by position, cells are as wide as the exist() radius
+    unordered_map<uint64_t, vector<int> > grid;
+
+    void insert(const Voxel &voxel);
 };
 
 #endif
\ No newline at end of file
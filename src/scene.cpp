@@ -1,47 +1,738 @@
 #include "scene.h"
 #include "camera.h"
 
+#include <algorithm>
+#include <cstdlib>
+
+// largest BVH subtree culled by a single task
+#define CULL_TASK_SIZE 2048
+
+// a brick is drawn once its cells shrink to about two pixels of a 720 line view
+#define LOD_CELL_NDC 0.006f
+
+// distinct trees per scene, every tree is a turned copy of one of them
+#define SAKURA_PROTOTYPES 3
+
+// streamed landscape: chunk edge, reach in chunks around the camera, and what the resident chunks may hold
+#define CHUNK_SIZE    384.0f
+#define STREAM_RADIUS 3
+#define STREAM_BUDGET (48 << 20)
+
+// chunks per builder pass, so a reset never waits behind a long queue; and retired chunks kept for their storage
+#define STREAM_BATCH  4
+#define STREAM_SPARES 8
+
+// the SPH open-sea tile repeats WAVE_TILES x WAVE_TILES times; its particles warm start from the checkpoint
+#define WAVE_TILES      2
+#define WAVE_CHECKPOINT "wave.ckpt"
+
 extern Camera *camera;
 
-Scene::Scene()
+// independent stream for node k of a scene, so the build order does not matter
+static unsigned int node_seed(unsigned int seed, int k)
+{
+    unsigned int h = seed + 0x9e3779b9u * (k + 1);
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static unsigned int chunk_seed(unsigned int seed, int cx, int cz)
+{
+    return node_seed(node_seed(seed, cx) ^ 0x2545f491u, cz);
+}
+
+static size_t chunk_bytes(const SceneChunk *c)
+{
+    return c->mountain->voxels.capacity() * sizeof(Voxel)
+         + c->mountain->occluder.capacity() * sizeof(glm::vec3)
+         + c->node.bvh.nodes.capacity() * sizeof(BVHNode)
+         + c->node.soa.x.capacity() * sizeof(float) * 4;
+}
+
+static void delete_chunk(SceneChunk *c)
+{
+    delete c->mountain;
+    delete c;
+}
+
+/*
+    The CPU side of a node, safe to run on any thread. Static content is
+    cleaned up and gets its hierarchy once, at generation time. A recycled
+    node keeps the capacity of its arrays.
+*/
+static void make_node(SceneNode *n, vector<Voxel> *voxels, const glm::vec3 &origin, bool dynamic, bool meshed, int &removed)
+{
+    n->voxels  = voxels;
+    n->origin  = origin;
+    n->dynamic = dynamic;
+    n->mesh    = -1;
+    n->resident = -1;
+
+    // in place, prototypes get their copies once the build is done
+    Placement here;
+    here.offset = glm::vec3(0.0f);
+    here.yaw    = 0;
+    n->placements.assign(1, here);
+
+    n->mesh_vertices.clear();
+    n->mesh_indices.clear();
+
+    removed = 0;
+
+    if (!dynamic)
+    {
+        // meshed first, enclosed voxels still hide the faces around them;
+        // the root box still culls the mesh as a whole
+        if (meshed)
+        {
+            greedy_mesh(*voxels, origin, n->mesh_vertices, n->mesh_indices);
+        }
+
+        removed = remove_hidden(*voxels);
+
+        n->bvh.build(*voxels, origin);
+        n->soa.build(*voxels, origin);
+
+        // instanced nodes carry their coarse levels after the fine voxels
+        if (!meshed)
+        {
+            n->bvh.build_bricks(*voxels, origin);
+        }
+    }
+}
+
+Scene::Scene(unsigned int _seed)
 {
+    seed = _seed;
     isVisit = false;
+    isOcclusion = true;
+    isMeshed = false;
+    isLod = true;
+    isStreaming = false;
+    isWave = false;
+    lod_limit = 0;
     degree = 0;
+    render_count = 0;
+    static_batches = 0;
+    static_count = 0;
+    dynamic_count = 0;
+    generation = 0;
+    generated_voxels = 0;
+    removed_voxels = 0;
+    coarse_voxels = 0;
+    culled_generation = ~0u;
     numSakura = 8;
     typeSakura = 1;
 
     node.clear();
 
-    Mountain *mountain = new Mountain(0, 0, 0);
-    node.push_back(&mountain->voxels);
+    // meshed nodes upload their geometry as they are installed
+    renderer = new OGLRenderer();
+
+    occlusion = new OcclusionBuffer(256, 128);
+
+    // made on first use, the solver state is global
+    wave = NULL;
+
+    ocean = new Ocean(0, -4, 0, 32, 128, 8, 320);
+
+    // a pool of its own, the render thread keeps the shared one while a rebuild runs
+    build_pool = new WorkerPool(std::max(1, (int) std::thread::hardware_concurrency() - 1));
+    build_ready = NULL;
+    build_requested = false;
+    build_quit = false;
+
+    current = NULL;
+    spare = NULL;
+
+    // the first scene is built before the first frame
+    request = settings();
+    install(build(request));
+
+    builder = std::thread(&Scene::buildLoop, this);
+}
+
+SceneSettings Scene::settings()
+{
+    SceneSettings s;
+    s.seed       = seed;
+    s.numSakura  = numSakura;
+    s.typeSakura = typeSakura;
+    s.meshed     = isMeshed;
+
+    return s;
+}
 
-    for (int i = 0; i < 360; i += 45)
+void Scene::addNode(SceneNode *n)
+{
+    if (!n->dynamic && !n->mesh_indices.empty())
     {
-        Sakura *sakura = new Sakura(sin(i * 3.14 / 180) * 260, 0, cos(i * 3.14 / 180) * 260, typeSakura);
-        node.push_back(&sakura->voxels);
+        n->mesh = renderer -> addMesh(n->mesh_vertices, n->mesh_indices);
+
+        printf("static mesh: %d voxels, %d triangles instanced, %d meshed\n",
+               (int) n->voxels->size(), (int) n->voxels->size() * 12, (int) n->mesh_indices.size() / 3);
+
+        // the GL buffers hold it now, the capacity stays for the next build
+        n->mesh_vertices.clear();
+        n->mesh_indices.clear();
     }
 
-    // wave = new Wave(200, 0, 300);
-    // node.push_back(&wave->voxels);
+    // uploaded once, each frame only says which of them are visible
+    if (!n->dynamic && n->mesh < 0)
+    {
+        n->resident = renderer -> addResident(*n->voxels);
+    }
 
-    renderer = new OGLRenderer();
+    node.push_back(n);
+
+    if (!n->dynamic)
+    {
+        generation++;
+    }
 }
 
-void Scene::reset()
+// the nodes themselves belong to their generation
+void Scene::clearNodes()
 {
+    for (int i = 0; i < node.size(); ++i)
+    {
+        if (node[i]->resident >= 0)
+        {
+            renderer -> removeResident(node[i]->resident);
+            node[i]->resident = -1;
+        }
+    }
+
     node.clear();
+    batches.clear();
+    generation++;
+
+    renderer -> clearMeshes();
+
+    generated_voxels = 0;
+    removed_voxels = 0;
+    coarse_voxels = 0;
+}
+
+void Scene::reportNodes()
+{
+    if (generated_voxels > 0)
+    {
+        printf("static voxels: %d generated, %d duplicate or hidden removed (%.1f%%)\n",
+               generated_voxels, removed_voxels, 100.0f * removed_voxels / generated_voxels);
+        printf("static bricks: %d coarse voxels\n", coarse_voxels);
+    }
+}
+
+/*
+    Only queues a rebuild, the current scene keeps rendering until the new
+    one is complete. Requests made while a build runs collapse into one
+    more build with the latest settings.
+*/
+void Scene::reset(bool fresh)
+{
+    std::lock_guard<std::mutex> guard(build_lock);
+
+    // still reproducible from the first seed, settings changes keep the scene
+    if (fresh)
+    {
+        seed = seed * 1664525u + 1013904223u;
+    }
+
+    request = settings();
+    build_requested = true;
+
+    build_wake.notify_one();
+}
+
+void Scene::buildLoop()
+{
+    std::unique_lock<std::mutex> guard(build_lock);
+
+    for (;;)
+    {
+        build_wake.wait(guard, [this] { return build_requested || build_quit || !chunk_requests.empty(); });
+
+        if (build_quit)
+        {
+            return;
+        }
+
+        if (build_requested)
+        {
+            build_requested = false;
+            SceneSettings wanted = request;
+
+            guard.unlock();
+            SceneBuild *done = build(wanted);
+            guard.lock();
+
+            // a finished build that never made it to the screen is already stale
+            if (build_ready != NULL)
+            {
+                recycle(build_ready);
+            }
+
+            build_ready = done;
+            continue;
+        }
+
+        // requests are queued nearest first
+        int n = std::min((int) chunk_requests.size(), STREAM_BATCH);
+        vector<SceneChunk *> todo(chunk_requests.begin(), chunk_requests.begin() + n);
+        chunk_requests.erase(chunk_requests.begin(), chunk_requests.begin() + n);
+
+        guard.unlock();
+        buildChunks(todo);
+        guard.lock();
+
+        chunk_ready.insert(chunk_ready.end(), todo.begin(), todo.end());
+    }
+}
+
+/*
+    Mountain and trees are built concurrently, each from its own seed,
+    and come back in a fixed order whichever thread built them. The
+    retired generation, if there is one, is regrown in place.
+*/
+SceneBuild *Scene::build(const SceneSettings &wanted)
+{
+    SceneBuild *b;
+
+    {
+        std::lock_guard<std::mutex> guard(build_lock);
+        b = spare;
+        spare = NULL;
+    }
+
+    if (b == NULL)
+    {
+        b = new SceneBuild();
+        b->mountain = NULL;
+    }
+
+    b->settings = wanted;
+    b->generated_voxels = 0;
+    b->removed_voxels = 0;
+    b->coarse_voxels = 0;
+
+    printf("scene seed: %u\n", wanted.seed);
+
+    vector<int> angles;
+
+    for (int i = 0; i < 360; i += 360 / wanted.numSakura)
+    {
+        angles.push_back(i);
+    }
+
+    int trees = angles.size();
+    int prototypes = std::min(trees, SAKURA_PROTOTYPES);
+
+    b->trees = trees;
+
+    // match the prototype count of this request, spare objects beyond it go
+    for (int k = prototypes; k < b->sakura.size(); ++k)
+    {
+        delete b->sakura[k];
+    }
 
-    Mountain *mountain = new Mountain(0, 0, 0);
-    node.push_back(&mountain->voxels);
+    for (int k = prototypes + 1; k < b->node.size(); ++k)
+    {
+        delete b->node[k];
+    }
+
+    b->sakura.resize(prototypes, NULL);
+    b->node.resize(prototypes + 1, NULL);
+
+    for (int k = 0; k < b->node.size(); ++k)
+    {
+        if (b->node[k] == NULL)
+        {
+            b->node[k] = new SceneNode();
+        }
+    }
+
+    vector<int> generated(prototypes + 1, 0);
+    vector<int> removed(prototypes + 1, 0);
+    vector<int> coarse(prototypes + 1, 0);
+
+    // job 0 is the mountain, job k is prototype k - 1
+    build_pool -> parallel_for(prototypes + 1, 1, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; ++k)
+        {
+            vector<Voxel> *voxels;
+            glm::vec3 origin;
+            unsigned int s = node_seed(wanted.seed, k);
+
+            if (k == 0)
+            {
+                if (b->mountain == NULL)
+                {
+                    b->mountain = new Mountain(0, 0, 0, s);
+                }
+                else
+                {
+                    b->mountain->generate(s);
+                }
+
+                voxels = &b->mountain->voxels;
+                origin = glm::vec3(b->mountain->xPos, b->mountain->yPos, b->mountain->zPos);
+            }
+            else
+            {
+                if (b->sakura[k - 1] == NULL)
+                {
+                    b->sakura[k - 1] = new Sakura(0, 0, 0, wanted.typeSakura, s);
+                }
+                else
+                {
+                    b->sakura[k - 1]->generate(0, 0, 0, wanted.typeSakura, s);
+                }
+
+                voxels = &b->sakura[k - 1]->voxels;
+                origin = glm::vec3(0.0f);
+            }
+
+            generated[k] = voxels->size();
+            make_node(b->node[k], voxels, origin, false, wanted.meshed, removed[k]);
+            coarse[k] = voxels->size() - (generated[k] - removed[k]);
+        }
+    });
+
+    // trees take the prototypes in turn, each turned its own way
+    for (int k = 1; k < b->node.size(); ++k)
+    {
+        b->node[k]->placements.clear();
+    }
+
+    for (int t = 0; t < trees; ++t)
+    {
+        int i = angles[t];
+
+        Placement place;
+        place.offset = glm::vec3(sin(i * 3.14 / 180) * 260, 0, cos(i * 3.14 / 180) * 260);
+        place.yaw    = node_seed(wanted.seed, SAKURA_PROTOTYPES + 1 + t) & 3;
+
+        b->node[1 + t % prototypes]->placements.push_back(place);
+    }
+
+    for (int k = 0; k < b->node.size(); ++k)
+    {
+        b->generated_voxels += generated[k];
+        b->removed_voxels   += removed[k];
+        b->coarse_voxels    += coarse[k];
+    }
+
+    return b;
+}
+
+// build_lock held; keeps one retired generation for its storage, frees the rest
+void Scene::recycle(SceneBuild *b)
+{
+    if (b == NULL)
+    {
+        return;
+    }
+
+    if (spare == NULL)
+    {
+        spare = b;
+    }
+    else
+    {
+        discard(b);
+    }
+}
+
+void Scene::discard(SceneBuild *b)
+{
+    if (b == NULL)
+    {
+        return;
+    }
 
-    int num = numSakura;
-    num = 360 / num;
+    for (int k = 0; k < b->node.size(); ++k)
+    {
+        delete b->node[k];
+    }
 
-    for (int i = 0; i < 360; i += num)
+    for (int k = 0; k < b->sakura.size(); ++k)
     {
-        Sakura *sakura = new Sakura(sin(i * 3.14 / 180) * 260, 0, cos(i * 3.14 / 180) * 260, typeSakura);
-        node.push_back(&sakura->voxels);
+        delete b->sakura[k];
     }
+
+    delete b->mountain;
+    delete b;
+}
+
+// builder thread, regrows recycled chunks in place
+void Scene::buildChunks(vector<SceneChunk *> &todo)
+{
+    build_pool -> parallel_for(todo.size(), 1, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; ++k)
+        {
+            SceneChunk *c = todo[k];
+            unsigned int s = chunk_seed(c->seed, c->cx, c->cz);
+
+            // jittered inside the chunk, clear of the neighbouring mountains
+            float x = (c->cx + ((s & 0xff) / 255.0f - 0.5f) * 0.25f) * CHUNK_SIZE;
+            float z = (c->cz + (((s >> 8) & 0xff) / 255.0f - 0.5f) * 0.25f) * CHUNK_SIZE;
+
+            if (c->mountain == NULL)
+            {
+                c->mountain = new Mountain(x, 0, z, s);
+            }
+            else
+            {
+                c->mountain->xPos = x;
+                c->mountain->zPos = z;
+                c->mountain->generate(s);
+            }
+
+            // never meshed, far chunks are what the bricks are for
+            int removed;
+            make_node(&c->node, &c->mountain->voxels, glm::vec3(x, 0, z), false, false, removed);
+        }
+    });
+}
+
+/*
+    Render thread, once per frame. Keeps the chunks within STREAM_RADIUS
+    of the camera resident or on their way, drops the ones that fell out
+    of reach, and the farthest ones while the budget is exceeded. The 3 x 3
+    chunks in the middle belong to the generated scene.
+*/
+void Scene::stream(const glm::vec3 &eye)
+{
+    vector<SceneChunk *> ready;
+    {
+        std::lock_guard<std::mutex> guard(build_lock);
+        ready.swap(chunk_ready);
+    }
+
+    int ex = (int) floor(eye.x / CHUNK_SIZE + 0.5f);
+    int ez = (int) floor(eye.z / CHUNK_SIZE + 0.5f);
+
+    for (int k = 0; k < ready.size(); ++k)
+    {
+        SceneChunk *c = ready[k];
+        pair<int, int> key(c->cx, c->cz);
+
+        chunk_pending.erase(key);
+
+        bool wanted = isStreaming
+                   && c->seed == current->settings.seed
+                   && std::max(abs(c->cx - ex), abs(c->cz - ez)) <= STREAM_RADIUS + 1;
+
+        if (wanted)
+        {
+            chunks[key] = c;
+            addNode(&c->node);
+        }
+        else
+        {
+            retire(c);
+        }
+    }
+
+    if (!isStreaming)
+    {
+        evictChunks();
+        return;
+    }
+
+    size_t bytes = 0;
+
+    // a chunk of slack, so the edge does not churn while the camera wanders
+    for (map<pair<int, int>, SceneChunk *>::iterator it = chunks.begin(); it != chunks.end();)
+    {
+        if (std::max(abs(it->first.first - ex), abs(it->first.second - ez)) > STREAM_RADIUS + 1)
+        {
+            evict(it->second);
+            chunks.erase(it++);
+        }
+        else
+        {
+            bytes += chunk_bytes(it->second);
+            ++it;
+        }
+    }
+
+    while (bytes > STREAM_BUDGET && !chunks.empty())
+    {
+        map<pair<int, int>, SceneChunk *>::iterator farthest = chunks.begin();
+        int far_d2 = -1;
+
+        for (map<pair<int, int>, SceneChunk *>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+        {
+            int dx = it->first.first - ex, dz = it->first.second - ez;
+
+            if (dx * dx + dz * dz > far_d2)
+            {
+                far_d2 = dx * dx + dz * dz;
+                farthest = it;
+            }
+        }
+
+        bytes -= chunk_bytes(farthest->second);
+        evict(farthest->second);
+        chunks.erase(farthest);
+    }
+
+    if (bytes >= STREAM_BUDGET)
+    {
+        return;
+    }
+
+    vector<pair<int, pair<int, int> > > missing;
+
+    for (int dz = -STREAM_RADIUS; dz <= STREAM_RADIUS; ++dz)
+    {
+        for (int dx = -STREAM_RADIUS; dx <= STREAM_RADIUS; ++dx)
+        {
+            pair<int, int> key(ex + dx, ez + dz);
+
+            if (std::max(abs(key.first), abs(key.second)) <= 1 || chunks.count(key) || chunk_pending.count(key))
+            {
+                continue;
+            }
+
+            missing.push_back(make_pair(dx * dx + dz * dz, key));
+        }
+    }
+
+    if (missing.empty())
+    {
+        return;
+    }
+
+    std::sort(missing.begin(), missing.end());
+
+    std::lock_guard<std::mutex> guard(build_lock);
+
+    for (int k = 0; k < missing.size(); ++k)
+    {
+        SceneChunk *c;
+
+        if (!chunk_spare.empty())
+        {
+            c = chunk_spare.back();
+            chunk_spare.pop_back();
+        }
+        else
+        {
+            c = new SceneChunk();
+            c->mountain = NULL;
+        }
+
+        c->cx   = missing[k].second.first;
+        c->cz   = missing[k].second.second;
+        c->seed = current->settings.seed;
+
+        chunk_requests.push_back(c);
+        chunk_pending.insert(missing[k].second);
+    }
+
+    build_wake.notify_one();
+}
+
+void Scene::evict(SceneChunk *c)
+{
+    vector<SceneNode *>::iterator it = std::find(node.begin(), node.end(), &c->node);
+
+    if (it != node.end())
+    {
+        node.erase(it);
+        generation++;
+    }
+
+    if (c->node.resident >= 0)
+    {
+        renderer -> removeResident(c->node.resident);
+        c->node.resident = -1;
+    }
+
+    retire(c);
+}
+
+// every resident chunk, and the requests the builder has not started on
+void Scene::evictChunks()
+{
+    for (map<pair<int, int>, SceneChunk *>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        evict(it->second);
+    }
+
+    chunks.clear();
+
+    vector<SceneChunk *> queued;
+    {
+        std::lock_guard<std::mutex> guard(build_lock);
+        queued.swap(chunk_requests);
+    }
+
+    for (int k = 0; k < queued.size(); ++k)
+    {
+        chunk_pending.erase(make_pair(queued[k]->cx, queued[k]->cz));
+        retire(queued[k]);
+    }
+}
+
+void Scene::retire(SceneChunk *c)
+{
+    if (chunk_spare.size() < STREAM_SPARES)
+    {
+        chunk_spare.push_back(c);
+    }
+    else
+    {
+        delete_chunk(c);
+    }
+}
+
+// render thread only, between frames
+void Scene::install(SceneBuild *b)
+{
+    clearNodes();
+
+    // chunks of the old seed go, the next frame asks for the new ones
+    evictChunks();
+
+    {
+        std::lock_guard<std::mutex> guard(build_lock);
+        recycle(current);
+    }
+
+    current  = b;
+    mountain = b->mountain;
+
+    for (int k = 0; k < b->node.size(); ++k)
+    {
+        addNode(b->node[k]);
+    }
+
+    addTiles(&ocean_node, &ocean->voxels, glm::vec3(ocean->xPos, ocean->yPos, ocean->zPos), ocean->offsets);
+
+    if (isWave)
+    {
+        addTiles(&wave_node, &wave->voxels, glm::vec3(wave->xPos, wave->yPos, wave->zPos), wave->offsets);
+    }
+
+    generated_voxels = b->generated_voxels;
+    removed_voxels   = b->removed_voxels;
+    coarse_voxels    = b->coarse_voxels;
+
+    printf("sakura: %d trees placed from %d prototypes\n", b->trees, (int) b->sakura.size());
+
+    reportNodes();
 }
 
 void Scene::toggleVisit()
@@ -49,6 +740,90 @@ void Scene::toggleVisit()
     isVisit = !isVisit;
 }
 
+void Scene::toggleOcclusion()
+{
+    isOcclusion = !isOcclusion;
+
+    // the reused static batches were culled under the old setting
+    generation++;
+
+    printf("occlusion culling %s\n", isOcclusion ? "on" : "off");
+}
+
+// a dynamic node whose voxels are one periodic tile, drawn once per offset
+void Scene::addTiles(SceneNode *n, vector<Voxel> *voxels, const glm::vec3 &origin, const vector<glm::vec3> &offsets)
+{
+    int removed;
+    make_node(n, voxels, origin, true, false, removed);
+
+    // one tile is rebuilt per frame, its repeats are placed copies
+    n->placements.clear();
+
+    for (int t = 0; t < offsets.size(); ++t)
+    {
+        Placement place;
+        place.offset = offsets[t];
+        place.yaw    = 0;
+
+        n->placements.push_back(place);
+    }
+
+    addNode(n);
+}
+
+void Scene::toggleMeshed()
+{
+    isMeshed = !isMeshed;
+
+    printf("static meshes %s\n", isMeshed ? "on" : "off");
+}
+
+void Scene::toggleLod()
+{
+    isLod = !isLod;
+
+    // the reused static batches picked their levels under the old setting
+    generation++;
+
+    printf("level of detail %s\n", isLod ? "on" : "off");
+}
+
+void Scene::toggleStreaming()
+{
+    isStreaming = !isStreaming;
+
+    printf("streamed landscape %s\n", isStreaming ? "on" : "off");
+}
+
+void Scene::toggleWave()
+{
+    if (wave == NULL)
+    {
+        wave = new Wave(200, 0, 300, WAVE_CHECKPOINT, WAVE_TILES);
+    }
+
+    isWave = !isWave;
+
+    if (isWave)
+    {
+        addTiles(&wave_node, &wave->voxels, glm::vec3(wave->xPos, wave->yPos, wave->zPos), wave->offsets);
+    }
+    else
+    {
+        vector<SceneNode *>::iterator it = std::find(node.begin(), node.end(), &wave_node);
+
+        if (it != node.end())
+        {
+            node.erase(it);
+        }
+
+        // static batches refer to nodes by index
+        generation++;
+    }
+
+    printf("wave %s, %d x %d tiles\n", isWave ? "on" : "off", WAVE_TILES, WAVE_TILES);
+}
+
 void Scene::switchType()
 {
     typeSakura = !typeSakura;
@@ -76,6 +851,19 @@ void Scene::decNum()
 
 void Scene::update()
 {
+    // a finished rebuild replaces the scene between frames
+    SceneBuild *ready;
+    {
+        std::lock_guard<std::mutex> guard(build_lock);
+        ready = build_ready;
+        build_ready = NULL;
+    }
+
+    if (ready != NULL)
+    {
+        install(ready);
+    }
+
     // Update camera
     if (isVisit == true)
     {
@@ -87,41 +875,322 @@ void Scene::update()
         degree += 0.1;
     }
 
-    // wave -> update();
+    if (isWave)
+    {
+        wave -> update();
+    }
+
+    ocean -> update(1 / 60.0f);
 
-    render_node.clear();
+    stream(camera -> camera_position);
 
-    // fov culling
+    for (int i = 0; i < node.size(); ++i)
+    {
+        if (node[i]->dynamic)
+        {
+            node[i]->bvh.build_ordered(*node[i]->voxels, node[i]->origin);
+            node[i]->soa.build(*node[i]->voxels, node[i]->origin);
+        }
+    }
+
+    /*
+        Parallel cull, one task per BVH subtree
+    */
     glm::mat4 pv = camera -> projection * camera -> view;
 
+    // a still view over the same content keeps last frame's depth, occluders
+    // and the occlusion setting only change with the generation
+    bool reuse = reuseStatic(pv);
+
+    if (isOcclusion && !reuse)
+    {
+        occlusion -> clear();
+        occlusion -> rasterize(pv, mountain -> occluder);
+
+        for (map<pair<int, int>, SceneChunk *>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+        {
+            occlusion -> rasterize(pv, it->second->mountain->occluder);
+        }
+        occlusion -> build_mips();
+    }
+
+    // cell / w against the NDC size, the projection scales both axes by about projection[1][1]
+    lod_limit = isLod ? LOD_CELL_NDC / camera -> projection[1][1] : 0;
+
+    int first = 0;
+
+    if (reuse)
+    {
+        // same view, same static content, only the dynamic nodes need work
+        batches.resize(static_batches);
+        first = static_batches;
+    }
+    else
+    {
+        batches.clear();
+
+        for (int i = 0; i < node.size(); ++i)
+        {
+            if (!node[i]->dynamic && node[i]->mesh < 0 && !node[i]->bvh.nodes.empty())
+            {
+                for (int p = 0; p < node[i]->placements.size(); ++p)
+                {
+                    split(i, p, 0);
+                }
+            }
+        }
+
+        static_batches    = batches.size();
+        culled_pv         = pv;
+        culled_generation = generation;
+    }
+
     for (int i = 0; i < node.size(); ++i)
     {
-        vector<Voxel> *nodev = node[i];
+        if (node[i]->dynamic && !node[i]->bvh.nodes.empty())
+        {
+            for (int p = 0; p < node[i]->placements.size(); ++p)
+            {
+                split(i, p, 0);
+            }
+        }
+    }
+
+    const Frustum &frustum = camera -> frustum;
+
+    // meshed nodes are drawn whole or not at all, once per placement
+    renderer -> beginMeshes();
+
+    for (int i = 0; i < node.size(); ++i)
+    {
+        if (node[i]->mesh >= 0 && !node[i]->bvh.nodes.empty())
+        {
+            const BVHNode &root = node[i]->bvh.nodes[0];
+
+            for (int p = 0; p < node[i]->placements.size(); ++p)
+            {
+                glm::mat4 model = node[i]->placements[p].model();
+
+                bool visible = frustum.transformed(model).test_box(root.min, root.max) != FRUSTUM_OUTSIDE;
+
+                if (visible && isOcclusion)
+                {
+                    visible = !occlusion -> occluded(pv * model, root.min, root.max);
+                }
 
-        for (int j = 0; j < nodev -> size(); ++j)
+                if (visible)
+                {
+                    renderer -> drawMesh(node[i]->mesh, model);
+                }
+            }
+        }
+    }
+
+    // fov culling against all six planes, whole boxes first, spheres only where a box straddles a plane,
+    // then boxes hidden behind the mountain are dropped; a placed copy is culled in its prototype's space
+    WorkerPool::shared().parallel_for(batches.size() - first, 1, [&](int begin, int end)
+    {
+        for (int b = first + begin; b < first + end; ++b)
         {
-            Voxel *tmp = &nodev -> at(j);
+            const Placement &place = batches[b].placement;
+
+            if (place.identity())
+            {
+                cull(batches[b], batches[b].root, frustum, pv);
+            }
+            else
+            {
+                glm::mat4 model = place.model();
+                cull(batches[b], batches[b].root, frustum.transformed(model), pv * model);
+            }
+        }
+    });
+
+    // prefix sums, static batches take slots in the visible index list and
+    // dynamic ones in the instance buffers; reused static slots stay put
+    if (first == 0)
+    {
+        static_count = 0;
+    }
+
+    dynamic_count = 0;
 
-            glm::vec4 coords = pv * glm::vec4(tmp->pos, 1);
+    for (int b = first; b < batches.size(); ++b)
+    {
+        int &slots = b < static_batches ? static_count : dynamic_count;
+
+        batches[b].offset = slots;
+        slots += batches[b].visible.size();
+    }
+
+    render_count = static_count + dynamic_count;
 
-            coords.x /= coords.w;
-            coords.y /= coords.w;
+    renderer -> update(batches, first, static_count, dynamic_count);
+}
 
-            if (!(coords.x < -1 || coords.x > 1 || coords.y < -1 || coords.y > 1 || coords.z < 0))
+bool Scene::reuseStatic(const glm::mat4 &pv)
+{
+    if (generation != culled_generation)
+    {
+        return false;
+    }
+
+    // camera damping leaves the matrices jittering in the last bits
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int r = 0; r < 4; ++r)
+        {
+            if (fabs(pv[c][r] - culled_pv[c][r]) > 1e-6f)
             {
-                render_node.push_back(tmp);
+                return false;
             }
         }
     }
 
-    renderer -> update(render_node);
+    return true;
+}
+
+void Scene::split(int i, int placement, int index)
+{
+    const BVHNode &box = node[i]->bvh.nodes[index];
+
+    if (box.count > CULL_TASK_SIZE && box.left >= 0)
+    {
+        split(i, placement, box.left);
+        split(i, placement, box.right);
+        return;
+    }
+
+    CullBatch batch;
+    batch.node   = i;
+    batch.root   = index;
+    batch.voxels = node[i]->voxels;
+    batch.origin = node[i]->origin;
+    batch.placement = node[i]->placements[placement];
+    batch.offset = 0;
+    batch.resident = node[i]->resident;
+
+    batches.push_back(batch);
+}
+
+void Scene::cull(CullBatch &batch, int index, const Frustum &frustum, const glm::mat4 &pv)
+{
+    SceneNode *n = node[batch.node];
+
+    const BVHNode &box = n->bvh.nodes[index];
+    vector<int> &visible = batch.visible;
+
+    int test = frustum.test_box(box.min, box.max);
+
+    if (test == FRUSTUM_OUTSIDE)
+    {
+        return;
+    }
+
+    if (isOcclusion && occlusion -> occluded(pv, box.min, box.max))
+    {
+        return;
+    }
+
+    // far enough that a brick cell covers a couple of pixels, measured at the nearest the box can be
+    if (box.lod_count > 0 && lod_limit > 0)
+    {
+        glm::vec3 centre = (box.min + box.max) * 0.5f;
+
+        float w = pv[0][3] * centre.x + pv[1][3] * centre.y + pv[2][3] * centre.z + pv[3][3]
+                - glm::length(box.max - centre);
+
+        if (brick_cell(box) < w * lod_limit)
+        {
+            for (int j = box.lod_first; j < box.lod_first + box.lod_count; ++j)
+            {
+                visible.push_back(j);
+            }
+
+            return;
+        }
+    }
+
+    // a box in view can still be partly hidden, or partly far enough for bricks, keep descending
+    if (test == FRUSTUM_INSIDE && box.left >= 0 && (isOcclusion || lod_limit > 0))
+    {
+        cull(batch, box.left, frustum, pv);
+        cull(batch, box.right, frustum, pv);
+        return;
+    }
+
+    if (test == FRUSTUM_INSIDE)
+    {
+        for (int j = box.first; j < box.first + box.count; ++j)
+        {
+            visible.push_back(j);
+        }
+
+        return;
+    }
+
+    if (box.left >= 0)
+    {
+        cull(batch, box.left, frustum, pv);
+        cull(batch, box.right, frustum, pv);
+        return;
+    }
+
+    // straddling leaf, spheres against the planes in the SIMD kernel
+    int offset = visible.size();
+    visible.resize(offset + box.count);
+    visible.resize(offset + cull_spheres(n->soa, box.first, box.count, frustum, &visible[offset]));
 }
 
 void Scene::render()
 {
-    renderer -> render(render_node);
+    renderer -> render();
 }
 
 Scene::~Scene()
 {
+    {
+        std::lock_guard<std::mutex> guard(build_lock);
+        build_quit = true;
+    }
+
+    build_wake.notify_one();
+    builder.join();
+
+    discard(build_ready);
+    discard(spare);
+    discard(current);
+
+    for (map<pair<int, int>, SceneChunk *>::iterator it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        delete_chunk(it->second);
+    }
+
+    for (int k = 0; k < chunk_spare.size(); ++k)
+    {
+        delete_chunk(chunk_spare[k]);
+    }
+
+    for (int k = 0; k < chunk_requests.size(); ++k)
+    {
+        delete_chunk(chunk_requests[k]);
+    }
+
+    for (int k = 0; k < chunk_ready.size(); ++k)
+    {
+        delete_chunk(chunk_ready[k]);
+    }
+
+    delete build_pool;
+    delete occlusion;
+
+    // the next run warm starts from where this one stopped
+    if (wave != NULL)
+    {
+        wave -> save(WAVE_CHECKPOINT);
+    }
+
+    delete wave;
+    delete ocean;
+    delete renderer;
 }
\ No newline at end of file
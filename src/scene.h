@@ -4,21 +4,140 @@
 #include "mountain.h"
 #include "sakura.h"
 #include "wave.h"
+#include "ocean.h"
 
 #include "render.h"
+#include "bvh.h"
+#include "frustum.h"
+#include "cull.h"
+#include "occlusion.h"
+#include "hidden.h"
+#include "mesher.h"
+#include "worker.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include <sys/time.h>
 
+struct SceneNode
+{
+    vector<Voxel> *voxels;
+
+    // voxel positions are relative to this
+    glm::vec3 origin;
+
+    // copies of the node in the world, a prototype has one per tree using it
+    vector<Placement> placements;
+
+    VoxelBVH bvh;
+    VoxelSoA soa;
+
+    // content rewritten every frame, hierarchy rebuilt in update()
+    bool dynamic;
+
+    // renderer mesh of a meshed static node, -1 when it is instanced
+    int mesh;
+
+    // renderer copy of an instanced static node's voxels, -1 until uploaded
+    int resident;
+
+    // merged geometry waiting for the render thread to upload it
+    vector<MeshVertex> mesh_vertices;
+    vector<unsigned int> mesh_indices;
+};
+
+// what a reset asks for
+struct SceneSettings
+{
+    unsigned int seed;
+    int numSakura;
+    int typeSakura;
+    bool meshed;
+};
+
+/*
+    One generation of static content, built off the render thread and
+    swapped in whole. It owns everything it points to, and a retired
+    generation is regrown in place by the next build.
+*/
+struct SceneBuild
+{
+    SceneSettings settings;
+
+    Mountain *mountain;
+
+    // tree prototypes, generated at the origin and placed many times
+    vector<Sakura *> sakura;
+    vector<SceneNode *> node;
+    int trees;
+
+    int generated_voxels;
+    int removed_voxels;
+    int coarse_voxels;
+};
+
+// one tile of the streamed landscape, a mountain somewhere inside it
+struct SceneChunk
+{
+    int cx, cz;
+
+    // seed of the generation it was requested for
+    unsigned int seed;
+
+    Mountain *mountain;
+    SceneNode node;
+};
+
 class Scene
 {
 public:
 
     OGLRenderer *renderer;
 
-    vector<vector<Voxel> *> node;
-    vector<Voxel *> render_node;
+    vector<SceneNode *> node;
+
+    // culling work split across threads, and the instances it produced
+    vector<CullBatch> batches;
+    int render_count;
+
+    // static batches come first, they are reused while the view holds still;
+    // their instances are indices into resident voxels
+    int static_batches;
+    int static_count;
+    int dynamic_count;
+
+    // bumped whenever static content changes
+    unsigned int generation;
+
+    // static voxels as generated, how many the hidden pass dropped, and the bricks' stand-ins
+    int generated_voxels;
+    int removed_voxels;
+    int coarse_voxels;
 
+    // the mountain of the generation on screen
+    Mountain *mountain;
     Wave *wave;
+    Ocean *ocean;
+
+    // software depth buffer filled from the mountain proxy every frame
+    OcclusionBuffer *occlusion;
+    bool isOcclusion;
+
+    // static nodes as merged meshes instead of instances, applies on reset
+    bool isMeshed;
+
+    // far subtrees drawn from their bricks
+    bool isLod;
+
+    // mountain chunks streamed in around the camera, outside the generated scene
+    bool isStreaming;
+
+    // SPH open-sea tile, only simulated while it is on
+    bool isWave;
 
     bool isVisit;
     float degree;
@@ -26,19 +145,88 @@ public:
     int numSakura;
     int typeSakura;
 
-    Scene();
+    // seeds the first scene, a reset asking for a new scene steps it
+    unsigned int seed;
+
+    Scene(unsigned int _seed);
     ~Scene();
 
     void update();
     void render();
 
-    void reset();
+    // rebuild with the current settings, fresh steps the seed for a new scene
+    void reset(bool fresh = false);
 
     void toggleVisit();
+    void toggleOcclusion();
+    void toggleMeshed();
+    void toggleLod();
+    void toggleStreaming();
+    void toggleWave();
 
     void incNum();
     void decNum();
     void switchType();
+
+private:
+
+    // a brick replaces its subtree once a cell is narrower than w * lod_limit
+    float lod_limit;
+
+    glm::mat4 culled_pv;
+    unsigned int culled_generation;
+
+    bool reuseStatic(const glm::mat4 &pv);
+
+    // background rebuilds, the newest request wins
+    std::thread builder;
+    std::mutex build_lock;
+    std::condition_variable build_wake;
+    bool build_requested;
+    bool build_quit;
+    SceneSettings request;
+    SceneBuild *build_ready;
+    WorkerPool *build_pool;
+
+    // the generation on screen, and a retired one kept for its storage
+    SceneBuild *current;
+    SceneBuild *spare;
+
+    // the ocean and the wave outlive generations
+    SceneNode ocean_node;
+    SceneNode wave_node;
+
+    SceneSettings settings();
+    void buildLoop();
+    SceneBuild *build(const SceneSettings &wanted);
+    void recycle(SceneBuild *b);
+    void discard(SceneBuild *b);
+    void install(SceneBuild *b);
+    void addTiles(SceneNode *n, vector<Voxel> *voxels, const glm::vec3 &origin, const vector<glm::vec3> &offsets);
+
+    /*
+        Streamed chunks. Resident, pending and spare chunks belong to the
+        render thread, chunk_requests and chunk_ready are handed to and
+        from the builder under build_lock.
+    */
+    map<pair<int, int>, SceneChunk *> chunks;
+    set<pair<int, int> > chunk_pending;
+    vector<SceneChunk *> chunk_spare;
+    vector<SceneChunk *> chunk_requests;
+    vector<SceneChunk *> chunk_ready;
+
+    void stream(const glm::vec3 &eye);
+    void buildChunks(vector<SceneChunk *> &todo);
+    void evict(SceneChunk *c);
+    void evictChunks();
+    void retire(SceneChunk *c);
+
+    void addNode(SceneNode *n);
+    void clearNodes();
+    void reportNodes();
+
+    void split(int i, int placement, int index);
+    void cull(CullBatch &batch, int index, const Frustum &frustum, const glm::mat4 &pv);
 };
 
 #endif
@@ -0,0 +1,195 @@
+#include "shallow.h"
+
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+ShallowWater::ShallowWater(int width, int depth, float cell_size, float wave_speed, float damping)
+    : width(width),
+      depth(depth),
+      cell_size(cell_size),
+      wave_speed(wave_speed),
+      damping(damping)
+{
+    origin_x = 0;
+    origin_z = 0;
+
+    // unknown until the first coupling
+    rest_height = -1;
+
+    height.assign(width * depth, 0.0f);
+    velocity.assign(width * depth, 0.0f);
+    inner.assign(width * depth, 0);
+    inner_height.assign(width * depth, 0.0f);
+}
+
+ShallowWater::~ShallowWater()
+{
+}
+
+void ShallowWater::set_footprint(float domain_width, float domain_depth)
+{
+    origin_x = domain_width / 2 - width * cell_size / 2;
+    origin_z = domain_depth / 2 - depth * cell_size / 2;
+
+    for (int j = 0; j < depth; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            float x = origin_x + (i + 0.5f) * cell_size;
+            float z = origin_z + (j + 0.5f) * cell_size;
+
+            inner[index(i, j)] = (x >= 0 && x <= domain_width && z >= 0 && z <= domain_depth);
+        }
+    }
+}
+
+void ShallowWater::couple(float dt)
+{
+    // first contact, settle the whole sea at the mean SPH level
+    if (rest_height < 0)
+    {
+        float sum = 0;
+        int count = 0;
+
+        for (int n = 0; n < width * depth; n++)
+        {
+            if (inner[n])
+            {
+                sum += inner_height[n];
+                count++;
+            }
+        }
+
+        rest_height = count > 0 ? sum / count : 0;
+        height.assign(width * depth, rest_height);
+    }
+
+    for (int n = 0; n < width * depth; n++)
+    {
+        if (inner[n])
+        {
+            velocity[n] = (inner_height[n] - height[n]) / dt;
+            height[n]   = inner_height[n];
+        }
+    }
+}
+
+void ShallowWater::update_velocity_row(int j, float k)
+{
+    const float *h  = &height[index(0, j)];
+    const float *up = h - width;
+    const float *dn = h + width;
+    float *v = &velocity[index(0, j)];
+
+    int i = 1;
+
+#ifdef __SSE__
+    __m128 vk   = _mm_set1_ps(k);
+    __m128 vd   = _mm_set1_ps(damping);
+    __m128 four = _mm_set1_ps(4.0f);
+
+    for (; i + 4 <= width - 1; i += 4)
+    {
+        __m128 c   = _mm_loadu_ps(h + i);
+        __m128 lap = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(h + i - 1), _mm_loadu_ps(h + i + 1)),
+                                _mm_add_ps(_mm_loadu_ps(up + i), _mm_loadu_ps(dn + i)));
+        lap = _mm_sub_ps(lap, _mm_mul_ps(four, c));
+
+        __m128 nv = _mm_add_ps(_mm_loadu_ps(v + i), _mm_mul_ps(vk, lap));
+        _mm_storeu_ps(v + i, _mm_mul_ps(nv, vd));
+    }
+#endif
+
+    for (; i < width - 1; i++)
+    {
+        float lap = h[i - 1] + h[i + 1] + up[i] + dn[i] - 4.0f * h[i];
+        v[i] = (v[i] + k * lap) * damping;
+    }
+}
+
+void ShallowWater::update_height_row(int j, float dt)
+{
+    float *h = &height[index(0, j)];
+    const float *v = &velocity[index(0, j)];
+
+    int i = 1;
+
+#ifdef __SSE__
+    __m128 vdt = _mm_set1_ps(dt);
+
+    for (; i + 4 <= width - 1; i += 4)
+    {
+        _mm_storeu_ps(h + i, _mm_add_ps(_mm_loadu_ps(h + i), _mm_mul_ps(vdt, _mm_loadu_ps(v + i))));
+    }
+#endif
+
+    for (; i < width - 1; i++)
+    {
+        h[i] += dt * v[i];
+    }
+}
+
+void ShallowWater::update_edges()
+{
+    // open sea, edges follow their inner neighbour so waves leave quietly
+    for (int i = 0; i < width; i++)
+    {
+        height[index(i, 0)]         = height[index(i, 1)];
+        height[index(i, depth - 1)] = height[index(i, depth - 2)];
+    }
+
+    for (int j = 0; j < depth; j++)
+    {
+        height[index(0, j)]         = height[index(1, j)];
+        height[index(width - 1, j)] = height[index(width - 2, j)];
+    }
+}
+
+void ShallowWater::step(float dt)
+{
+    float k = wave_speed * wave_speed * dt / (cell_size * cell_size);
+
+    for (int j = 1; j < depth - 1; j++)
+    {
+        update_velocity_row(j, k);
+    }
+
+    for (int j = 1; j < depth - 1; j++)
+    {
+        update_height_row(j, dt);
+    }
+
+    update_edges();
+
+    // footprint stays pinned to the particles
+    for (int n = 0; n < width * depth; n++)
+    {
+        if (inner[n])
+        {
+            height[n] = inner_height[n];
+        }
+    }
+}
+
+float ShallowWater::height_at(float x, float z)
+{
+    float fx = (x - origin_x) / cell_size - 0.5f;
+    float fz = (z - origin_z) / cell_size - 0.5f;
+
+    fx = fmin(fmax(fx, 0.0f), width - 1.001f);
+    fz = fmin(fmax(fz, 0.0f), depth - 1.001f);
+
+    int i = (int) fx;
+    int j = (int) fz;
+
+    float tx = fx - i;
+    float tz = fz - j;
+
+    float h0 = height[index(i, j)]     * (1 - tx) + height[index(i + 1, j)]     * tx;
+    float h1 = height[index(i, j + 1)] * (1 - tx) + height[index(i + 1, j + 1)] * tx;
+
+    return h0 * (1 - tz) + h1 * tz;
+}
@@ -0,0 +1,64 @@
+#ifndef SHALLOW_H_
+#define SHALLOW_H_
+
+#include <vector>
+using namespace std;
+
+/*
+    2D heightfield water for the far field around the SPH domain.
+    Cells inside the SPH footprint are driven by the particles, the
+    rest propagate them outward with the linear shallow-water equation.
+*/
+
+class ShallowWater
+{
+public:
+    const int width;
+    const int depth;
+
+    const float cell_size;
+    const float wave_speed;
+    const float damping;
+
+    // world offset of cell (0, 0) relative to the SPH domain origin
+    float origin_x;
+    float origin_z;
+
+    float rest_height;
+
+    vector<float> height;
+    vector<float> velocity;
+
+    // cells covered by SPH and their particle surface heights
+    vector<unsigned char> inner;
+    vector<float> inner_height;
+
+    ShallowWater(int width, int depth, float cell_size, float wave_speed, float damping);
+    ~ShallowWater();
+
+    // place the SPH footprint [0, domain_width] x [0, domain_depth] at the center
+    void set_footprint(float domain_width, float domain_depth);
+
+    // SPH -> heightfield, drive the footprint cells from inner_height
+    void couple(float dt);
+
+    void step(float dt);
+
+    // heightfield -> SPH, bilinear surface height at SPH local x, z
+    float height_at(float x, float z);
+
+    int index(int i, int j)
+    {
+        return j * width + i;
+    }
+
+private:
+
+    void update_velocity_row(int j, float k);
+
+    void update_height_row(int j, float dt);
+
+    void update_edges();
+};
+
+#endif
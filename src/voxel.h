@@ -4,12 +4,79 @@
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 
+#include <cmath>
+
+// fixed point steps, positions in 1/16 and sizes in 1/256 of a unit
+#define VOXEL_UNIT  16.0f
+#define VOXEL_SCALE 256.0f
+
+/*
+    12 bytes per voxel. The position is relative to the origin of the node
+    that owns it, +-2048 units around it; scale is the half edge.
+*/
 typedef struct
 {
-    glm::vec3 pos;
-    glm::vec4 color;
-    float scale;
-    float rotate;
+    short x, y, z;
+    unsigned short scale;
+
+    // RGBA8
+    unsigned char color[4];
 } Voxel;
 
-#endif
\ No newline at end of file
+// x, y or z by index; the members are separate fields, not an array
+inline short voxel_axis(const Voxel &v, int axis)
+{
+    switch (axis)
+    {
+    case 0:
+        return v.x;
+
+    case 1:
+        return v.y;
+
+    default:
+        return v.z;
+    }
+}
+
+inline short clamp_short(float q)
+{
+    return (short) (q < -32768 ? -32768 : (q > 32767 ? 32767 : q));
+}
+
+inline Voxel make_voxel(const glm::vec3 &local, float scale, const glm::vec4 &color)
+{
+    Voxel v;
+
+    v.x = clamp_short(floor(local.x * VOXEL_UNIT + 0.5f));
+    v.y = clamp_short(floor(local.y * VOXEL_UNIT + 0.5f));
+    v.z = clamp_short(floor(local.z * VOXEL_UNIT + 0.5f));
+
+    float s = floor(scale * VOXEL_SCALE + 0.5f);
+    v.scale = (unsigned short) (s < 0 ? 0 : (s > 65535 ? 65535 : s));
+
+    for (int i = 0; i < 4; i++)
+    {
+        float c = floor(color[i] * 255 + 0.5f);
+        v.color[i] = (unsigned char) (c < 0 ? 0 : (c > 255 ? 255 : c));
+    }
+
+    return v;
+}
+
+inline glm::vec3 voxel_pos(const Voxel &v, const glm::vec3 &origin)
+{
+    return origin + glm::vec3(v.x, v.y, v.z) / VOXEL_UNIT;
+}
+
+inline float voxel_scale(const Voxel &v)
+{
+    return v.scale / VOXEL_SCALE;
+}
+
+inline glm::vec4 voxel_color(const Voxel &v)
+{
+    return glm::vec4(v.color[0], v.color[1], v.color[2], v.color[3]) / 255.0f;
+}
+
+#endif
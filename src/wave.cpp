@@ -1,7 +1,13 @@
 #include "wave.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
 #define WIDTH       20 * 3
@@ -14,21 +20,64 @@ const float gravity = 15.0f;
 const float scale = 1.0f;
 float collision_restitution = 1.1f;
 
+// 40.96 degrees per second keeps the old per-particle drift of an 8192 particle tank
+WaveMaker wave_maker(WIDTH, 30.0f, 40.96f, 80.0f);
+
+// far field pushing back on the particles through the open faces
+ShallowWater *coupled_far_field = NULL;
+const float far_field_coupling = 0.5f;
+
+// travelling push that replaces the wall in open-sea mode
+const float swell_strength = 4.0f;
+
 Vector3f gravity_direction;
 
-Wave::Wave(float _x, float _y, float _z)
+Wave::Wave(float _x, float _y, float _z, const char *checkpoint, int _tiles)
 {
     xPos = _x;
     yPos = _y;
     zPos = _z;
+    tiles = _tiles;
 
     voxels.clear();
 
+    if (tiles > 0)
+    {
+        // open sea, the repeated tile stands in for the far field
+        solver.periodic_x = true;
+        solver.periodic_z = true;
+        far_field = NULL;
+
+        // the seams line up by construction, the copies need no voxels of their own
+        for (int tz = 0; tz < tiles; tz++)
+        {
+            for (int tx = 0; tx < tiles; tx++)
+            {
+                offsets.push_back(glm::vec3(tx * solver.period_x(), 0, tz * solver.period_z()) * scale);
+            }
+        }
+    }
+    else
+    {
+        far_field = new ShallowWater(64, 64, 6.0f, 12.0f, 0.995f);
+        far_field->set_footprint(WIDTH, DEPTH);
+
+        offsets.push_back(glm::vec3(0.0f));
+    }
+
+    coupled_far_field = far_field;
+
     gravity_direction.x = 0;
     gravity_direction.y = -1;
     gravity_direction.z = 0;
     gravity_direction = normalize(gravity_direction);
 
+    // warm start from a settled ocean if we have one
+    if (checkpoint != NULL && solver.load_checkpoint(checkpoint, &wave_maker.phase))
+    {
+        return;
+    }
+
     Particle *particles = new Particle[8192];
 
     int count = 8192;
@@ -62,47 +111,92 @@ void add_gravity_force(Particle &particle)
     particle.force += gravity * gravity_direction * particle.density;
 }
 
-void add_global_forces()
+void add_far_field_force(Particle &particle)
 {
-    solver.foreach_particle(add_gravity_force);
-}
+    float band = solver.core_radius;
 
-void handle_particle_collision_cube(Particle &particle)
-{
-    static float alpha = 0;
-    float test = WIDTH + sin(alpha * 3.14 / 180) * 30 - particle.position.y * particle.position.y / 80;
-    alpha += 0.00005;
+    float &px = particle.position.x;
+    float &py = particle.position.y;
+    float &pz = particle.position.z;
 
-    if (alpha >= 360)
+    Vector3f normal(0.0f);
+    float ox = px, oz = pz;
+
+    // x = WIDTH is the wave-maker wall, the other sides are open sea
+    if (px < band)
+    {
+        normal.x = 1;
+        ox = -band;
+    }
+    else if (pz < band)
     {
-        alpha = 0;
+        normal.z = 1;
+        oz = -band;
+    }
+    else if (pz > DEPTH - band)
+    {
+        normal.z = -1;
+        oz = DEPTH + band;
+    }
+    else
+    {
+        return;
     }
 
-    float &px = particle.position.x;
-    float &py = particle.position.y;
-    float &pz = particle.position.z;
+    float outside = coupled_far_field->height_at(ox, oz);
+
+    if (py > outside)
+    {
+        return;
+    }
 
-    float &vx = particle.velocity.x;
-    float &vy = particle.velocity.y;
-    float &vz = particle.velocity.z;
+    float inside = coupled_far_field->height_at(px, pz);
+    particle.force += far_field_coupling * gravity * (outside - inside) * particle.density * normal;
+}
+
+void add_global_forces()
+{
+    solver.foreach_particle(add_gravity_force);
 
-    if (px < 0 || px > test / scale)
+    if (coupled_far_field != NULL)
     {
-        px = min(max(px, 0.0f), (float) test / scale);
-        vx *= -collision_restitution;
+        solver.foreach_particle(add_far_field_force);
     }
-    if (py < 0 || py > HEIGHT / scale)
+}
+
+void WaveMaker::advance(float dt)
+{
+    phase += speed * dt;
+
+    if (phase >= 360)
     {
-        py = min(max(py, 0.0f), (float) HEIGHT / scale);
-        vy *= -collision_restitution;
+        phase -= 360;
     }
-    if (pz < 0 || pz > DEPTH / scale)
+
+    offset = base + sin(phase * 3.14 / 180) * amplitude;
+}
+
+inline void clamp_axis(float &p, float &v, float hi)
+{
+    float c = min(max(p, 0.0f), hi);
+
+    if (c != p)
     {
-        pz = min(max(pz, 0.0f), (float) DEPTH / scale);
-        vz *= -collision_restitution;
+        p = c;
+        v *= -collision_restitution;
     }
 }
 
+void handle_particle_collision_cube(Particle &particle)
+{
+    // the wall is one multiply-add per particle, the sine was taken once this step
+    float wall = wave_maker.wall(particle.position.y);
+
+    clamp_axis(particle.position.x, particle.velocity.x, wall / scale);
+    clamp_axis(particle.position.y, particle.velocity.y, (float) HEIGHT / scale);
+    clamp_axis(particle.position.z, particle.velocity.z, (float) DEPTH / scale);
+}
+
 void handle_particle_collision_cylinder(Particle &particle) {
     Vector3f mid = Vector3f(WIDTH, 0.0f, DEPTH) / 2.0f;
     Vector3f distance = Vector3f(particle.position.x, 0.0f, particle.position.z) - mid;
@@ -125,20 +219,67 @@ void handle_particle_collision_cylinder(Particle &particle) {
     }
 }
 
+void handle_particle_collision_open_sea(Particle &particle)
+{
+    // only floor and lid, x / z wrap in the solver
+    clamp_axis(particle.position.y, particle.velocity.y, (float) HEIGHT / scale);
+}
+
 void handle_collisions()
 {
+    wave_maker.advance(solver.timestep);
     solver.foreach_particle(handle_particle_collision_cube);
 }
 
+/*
+    Without a wall the wave-maker becomes a travelling push along x,
+    one swell per tile so it wraps seamlessly.
+*/
+void add_swell_force(Particle &particle)
+{
+    float phase = 2 * 3.14 * particle.position.x / solver.period_x() - wave_maker.phase * 3.14 / 180;
+    particle.force.x += swell_strength * sin(phase) * particle.density;
+}
+
+void add_open_sea_forces()
+{
+    solver.foreach_particle(add_gravity_force);
+    solver.foreach_particle(add_swell_force);
+}
+
+void handle_open_sea_collisions()
+{
+    wave_maker.advance(solver.timestep);
+    solver.foreach_particle(handle_particle_collision_open_sea);
+}
+
 void Wave::update()
 {
     for (int i = 0; i < 2; ++i)
     {
-        solver.update(add_global_forces, handle_collisions);
+        if (tiles > 0)
+        {
+            solver.update(add_open_sea_forces, handle_open_sea_collisions);
+        }
+        else
+        {
+            solver.update(add_global_forces, handle_collisions);
+        }
     }
 
     voxels.clear();
 
+    /*
+        SPH -> far field, column surface heights over the footprint
+    */
+    if (far_field != NULL)
+    {
+        for (int n = 0; n < far_field->width * far_field->depth; n++)
+        {
+            far_field->inner_height[n] = 0;
+        }
+    }
+
     for (int k = 0; k < solver.grid_depth; k++)
     {
         for (int j = 0; j < solver.grid_height; j++)
@@ -151,24 +292,71 @@ void Wave::update()
                 for (list<Particle>::iterator piter = plist.begin(); piter != plist.end(); piter++)
                 {
                     Vector3f p = scale * piter -> position;
-                    Voxel tmp;
-                    tmp.scale = 32 / (piter -> density * 100);
-                    tmp.pos = glm::vec3(xPos + p.x, yPos + p.y, zPos + p.z);
-                    // tmp.color = glm::vec4(piter -> color_gradient.x, piter -> color_gradient.y, piter -> color_gradient.z, 1);
-                    tmp.color = glm::vec4(31, 71, 136, 255) / 128.0f * length(piter -> color_gradient);
+                    // glm::vec4 color = glm::vec4(piter -> color_gradient.x, piter -> color_gradient.y, piter -> color_gradient.z, 1);
+                    glm::vec4 color = glm::vec4(31, 71, 136, 255) / 128.0f * length(piter -> color_gradient);
                     // if (length(piter -> color_gradient) > 0.5f)
                     // {
-                        // tmp.color = glm::vec4(235, 246, 247, 255) / 255.0f;
+                        // color = glm::vec4(235, 246, 247, 255) / 255.0f;
                     // }
-                    voxels.push_back(tmp);
+
+                    // relative to the wave's origin
+                    voxels.push_back(make_voxel(glm::vec3(p.x, p.y, p.z), 32 / (piter -> density * 100), color));
+
+                    if (far_field != NULL)
+                    {
+                        int fi = (int) ((piter -> position.x - far_field->origin_x) / far_field->cell_size);
+                        int fk = (int) ((piter -> position.z - far_field->origin_z) / far_field->cell_size);
+                        float &column = far_field->inner_height[far_field->index(fi, fk)];
+                        column = max(column, piter -> position.y);
+                    }
                 }
             }
         }
     }
+
+    // the open sea has no far field, its tile is repeated through offsets
+    if (tiles > 0)
+    {
+        return;
+    }
+
+    far_field->couple(2 * solver.timestep);
+    far_field->step(2 * solver.timestep);
+
+    for (int k = 0; k < far_field->depth; k++)
+    {
+        for (int i = 0; i < far_field->width; i++)
+        {
+            int n = far_field->index(i, k);
+
+            if (far_field->inner[n])
+            {
+                continue;
+            }
+
+            glm::vec3 local(far_field->origin_x + (i + 0.5f) * far_field->cell_size,
+                            far_field->height[n],
+                            far_field->origin_z + (k + 0.5f) * far_field->cell_size);
+
+            voxels.push_back(make_voxel(local, far_field->cell_size / 4, glm::vec4(31, 71, 136, 255) / 255.0f));
+        }
+    }
+}
+
+bool Wave::save(const char *path)
+{
+    return solver.save_checkpoint(path, wave_maker.phase);
 }
 
 Wave::~Wave()
 {
+    // the collision callbacks must not reach a freed far field
+    if (coupled_far_field == far_field)
+    {
+        coupled_far_field = NULL;
+    }
+
+    delete far_field;
 }
 
 #define PI_FLOAT                3.14
@@ -209,14 +397,46 @@ inline float SphFluidSolver::laplacian_viscosity_kernel(const Vector3f &r, const
     return 45.0f / (PI_FLOAT * POW6(h)) * (h - length(r));
 }
 
-inline void SphFluidSolver::add_density(Particle &particle, Particle &neighbour)
+inline bool SphFluidSolver::neighbour_cell(int &x, int y, int &z, Vector3f &shift)
+{
+    shift = Vector3f(0.0f);
+
+    if (periodic_x && x < 0)
+    {
+        x += grid_width;
+        shift.x = -period_x();
+    }
+    else if (periodic_x && x >= grid_width)
+    {
+        x -= grid_width;
+        shift.x = period_x();
+    }
+
+    if (periodic_z && z < 0)
+    {
+        z += grid_depth;
+        shift.z = -period_z();
+    }
+    else if (periodic_z && z >= grid_depth)
+    {
+        z -= grid_depth;
+        shift.z = period_z();
+    }
+
+    return    (x >= 0) && (x < grid_width)
+           && (y >= 0) && (y < grid_height)
+           && (z >= 0) && (z < grid_depth);
+}
+
+inline void SphFluidSolver::add_density(Particle &particle, Particle &neighbour, const Vector3f &shift)
 {
     if (particle.id > neighbour.id)
     {
         return;
     }
 
-    Vector3f r = particle.position - neighbour.position;
+    // shift moves the neighbour to its image next to the particle
+    Vector3f r = particle.position - neighbour.position - shift;
     if (dot(r, r) > SQR(core_radius))
     {
         return;
@@ -227,12 +447,12 @@ inline void SphFluidSolver::add_density(Particle &particle, Particle &neighbour)
     neighbour.density += particle.mass * common;
 }
 
-void SphFluidSolver::sum_density(GridElement &grid_element, Particle &particle)
+void SphFluidSolver::sum_density(GridElement &grid_element, Particle &particle, const Vector3f &shift)
 {
     list<Particle> &plist = grid_element.particles;
     for (list<Particle>::iterator piter = plist.begin(); piter != plist.end(); piter++)
     {
-        add_density(particle, *piter);
+        add_density(particle, *piter, shift);
     }
 }
 
@@ -244,14 +464,15 @@ inline void SphFluidSolver::sum_all_density(int i, int j, int k, Particle &parti
         {
             for (int x = i - 1; x <= i + 1; x++)
             {
-                if (   (x < 0) || (x >= grid_width)
-                        || (y < 0) || (y >= grid_height)
-                        || (z < 0) || (z >= grid_depth))
+                int wx = x, wz = z;
+                Vector3f shift;
+
+                if (!neighbour_cell(wx, y, wz, shift))
                 {
                     continue;
                 }
 
-                sum_density(grid(x, y, z), particle);
+                sum_density(grid(wx, y, wz), particle, shift);
             }
         }
     }
@@ -268,14 +489,14 @@ void SphFluidSolver::update_densities(int i, int j, int k)
     }
 }
 
-inline void SphFluidSolver::add_forces(Particle &particle, Particle &neighbour)
+inline void SphFluidSolver::add_forces(Particle &particle, Particle &neighbour, const Vector3f &shift)
 {
     if (particle.id >= neighbour.id)
     {
         return;
     }
 
-    Vector3f r = particle.position - neighbour.position;
+    Vector3f r = particle.position - neighbour.position - shift;
     if (dot(r, r) > SQR(core_radius))
     {
         return;
@@ -309,12 +530,12 @@ inline void SphFluidSolver::add_forces(Particle &particle, Particle &neighbour)
     neighbour.color_laplacian += particle.mass / particle.density * value;
 }
 
-void SphFluidSolver::sum_forces(GridElement &grid_element, Particle &particle)
+void SphFluidSolver::sum_forces(GridElement &grid_element, Particle &particle, const Vector3f &shift)
 {
     list<Particle>  &plist = grid_element.particles;
     for (list<Particle>::iterator piter = plist.begin(); piter != plist.end(); piter++)
     {
-        add_forces(particle, *piter);
+        add_forces(particle, *piter, shift);
     }
 }
 
@@ -326,14 +547,15 @@ void SphFluidSolver::sum_all_forces(int i, int j, int k, Particle &particle)
         {
             for (int x = i - 1; x <= i + 1; x++)
             {
-                if (   (x < 0) || (x >= grid_width)
-                        || (y < 0) || (y >= grid_height)
-                        || (z < 0) || (z >= grid_depth))
+                int wx = x, wz = z;
+                Vector3f shift;
+
+                if (!neighbour_cell(wx, y, wz, shift))
                 {
                     continue;
                 }
 
-                sum_forces(grid(x, y, z), particle);
+                sum_forces(grid(wx, y, wz), particle, shift);
             }
         }
     }
@@ -416,6 +638,32 @@ inline void SphFluidSolver::insert_into_grid(int i, int j, int k)
     }
 }
 
+void SphFluidSolver::wrap_particles()
+{
+    for (int n = 0; n < grid_width * grid_height * grid_depth; n++)
+    {
+        list<Particle> &plist = grid_elements[n].particles;
+        for (list<Particle>::iterator piter = plist.begin(); piter != plist.end(); piter++)
+        {
+            Vector3f &p = piter->position;
+
+            if (periodic_x)
+            {
+                p.x = fmod(p.x, period_x());
+                p.x = p.x < 0 ? p.x + period_x() : p.x;
+                p.x = p.x >= period_x() ? 0.0f : p.x;
+            }
+
+            if (periodic_z)
+            {
+                p.z = fmod(p.z, period_z());
+                p.z = p.z < 0 ? p.z + period_z() : p.z;
+                p.z = p.z >= period_z() ? 0.0f : p.z;
+            }
+        }
+    }
+}
+
 void SphFluidSolver::update_grid()
 {
     for (int k = 0; k < grid_depth; k++)
@@ -521,6 +769,12 @@ void SphFluidSolver::update(void(*inter_hook)(), void(*post_hook)())
         post_hook();
     }
 
+    /* Particles leaving a periodic face come back on the other side. */
+    if (periodic_x || periodic_z)
+    {
+        wrap_particles();
+    }
+
     update_grid();
 }
 
@@ -537,6 +791,132 @@ void SphFluidSolver::init_particles(Particle *particles, int count)
     }
 }
 
+int SphFluidSolver::particle_count()
+{
+    int count = 0;
+
+    for (int n = 0; n < grid_width * grid_height * grid_depth; n++)
+    {
+        count += grid_elements[n].particles.size();
+    }
+
+    return count;
+}
+
+#define CHECKPOINT_MAGIC    "UKIYOSPH"
+#define CHECKPOINT_VERSION  2
+
+bool SphFluidSolver::save_checkpoint(const char *path, float phase)
+{
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+
+    header.version       = CHECKPOINT_VERSION;
+    header.particle_size = sizeof(Particle);
+    header.grid_width    = grid_width;
+    header.grid_height   = grid_height;
+    header.grid_depth    = grid_depth;
+    header.periodic      = (periodic_x ? 1 : 0) | (periodic_z ? 2 : 0);
+    header.core_radius   = core_radius;
+    header.timestep      = timestep;
+    header.gas_constant  = material.gas_constant;
+    header.mu            = material.mu;
+    header.rest_density  = material.rest_density;
+    header.sigma         = material.sigma;
+    header.point_damping = material.point_damping;
+    header.phase         = phase;
+    header.count         = particle_count();
+
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        printf("checkpoint: can not write %s\n", path);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (int n = 0; n < grid_width * grid_height * grid_depth; n++)
+    {
+        list<Particle> &plist = grid_elements[n].particles;
+        for (list<Particle>::iterator piter = plist.begin(); piter != plist.end(); piter++)
+        {
+            fwrite(&(*piter), sizeof(Particle), 1, file);
+        }
+    }
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+
+    printf("checkpoint: saved %d particles to %s\n", header.count, path);
+
+    return ok;
+}
+
+bool SphFluidSolver::load_checkpoint(const char *path, float *phase)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CheckpointHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    // private writable mapping, init_particles renumbers ids in place
+    void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    CheckpointHeader *header = (CheckpointHeader *) data;
+
+    bool ok =    memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) == 0
+              && header->version       == CHECKPOINT_VERSION
+              && header->particle_size == (int) sizeof(Particle)
+              && header->grid_width    == grid_width
+              && header->grid_height   == grid_height
+              && header->grid_depth    == grid_depth
+              && header->periodic      == ((periodic_x ? 1 : 0) | (periodic_z ? 2 : 0))
+              && header->core_radius   == core_radius
+              && header->timestep      == timestep
+              && header->gas_constant  == material.gas_constant
+              && header->mu            == material.mu
+              && header->rest_density  == material.rest_density
+              && header->sigma         == material.sigma
+              && header->point_damping == material.point_damping
+              && header->count > 0
+              && st.st_size >= (off_t) (sizeof(CheckpointHeader) + header->count * sizeof(Particle));
+
+    if (ok)
+    {
+        init_particles((Particle *) (header + 1), header->count);
+        *phase = header->phase;
+
+        printf("checkpoint: restored %d particles from %s\n", header->count, path);
+    }
+    else
+    {
+        printf("checkpoint: %s does not match this solver, ignored\n", path);
+    }
+
+    munmap(data, st.st_size);
+
+    return ok;
+}
+
 inline GridElement &SphFluidSolver::grid(int i, int j, int k)
 {
     return grid_elements[grid_index(i, j, k)];
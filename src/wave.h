@@ -6,6 +6,7 @@
 using namespace std;
 
 #include "voxel.h"
+#include "shallow.h"
 
 struct Vector3f
 {
@@ -244,6 +245,45 @@ struct FluidMaterial
     }
 };
 
+/*
+    Moving wall at the far x end of the tank. The phase advances once per
+    solver step, the wall leans back with height by y * y / curve.
+*/
+struct WaveMaker
+{
+    float base;
+    float amplitude;
+    float speed;
+
+    // fixed for the wave-maker's life, wall() runs per particle on 1 / curve
+    const float curve;
+    const float inv_curve;
+
+    // degrees
+    float phase;
+
+    // wall x at y = 0 for the current step
+    float offset;
+
+    WaveMaker(float base, float amplitude, float speed, float curve)
+        : base(base),
+          amplitude(amplitude),
+          speed(speed),
+          curve(curve),
+          inv_curve(1.0f / curve)
+    {
+        phase = 0;
+        offset = base;
+    }
+
+    void advance(float dt);
+
+    inline float wall(float y)
+    {
+        return offset - y * y * inv_curve;
+    }
+};
+
 class SphFluidSolver
 {
 public:
@@ -259,6 +299,10 @@ public:
     GridElement *grid_elements;
     GridElement *sleeping_grid_elements;
 
+    // wrap around in x / z, the tile is grid_width * core_radius wide
+    bool periodic_x;
+    bool periodic_z;
+
     SphFluidSolver(
         float domain_width,
         float domain_height,
@@ -273,13 +317,30 @@ public:
           timestep(timestep),
           material(material)
     {
+        periodic_x = false;
+        periodic_z = false;
+    }
+
+    float period_x()
+    {
+        return grid_width * core_radius;
+    }
 
+    float period_z()
+    {
+        return grid_depth * core_radius;
     }
 
     void update(void(*inter_hook)() = NULL, void(*post_hook)() = NULL);
 
     void init_particles(Particle *particles, int count);
 
+    int particle_count();
+
+    // binary checkpoint of particles, grid, material and wave-maker phase
+    bool save_checkpoint(const char *path, float phase);
+    bool load_checkpoint(const char *path, float *phase);
+
     template <typename Function>
     void foreach_particle(Function function)
     {
@@ -313,17 +374,19 @@ private:
 
     float laplacian_viscosity_kernel(const Vector3f &r, const float h);
 
-    void add_density(Particle &particle, Particle &neighbour);
+    bool neighbour_cell(int &x, int y, int &z, Vector3f &shift);
 
-    void sum_density(GridElement &grid_element, Particle &particle);
+    void add_density(Particle &particle, Particle &neighbour, const Vector3f &shift);
+
+    void sum_density(GridElement &grid_element, Particle &particle, const Vector3f &shift);
 
     void sum_all_density(int i, int j, int k, Particle &particle);
 
     void update_densities(int i, int j, int k);
 
-    void add_forces(Particle &particle, Particle &neighbour);
+    void add_forces(Particle &particle, Particle &neighbour, const Vector3f &shift);
 
-    void sum_forces(GridElement &grid_element, Particle &particle);
+    void sum_forces(GridElement &grid_element, Particle &particle, const Vector3f &shift);
 
     void sum_all_forces(int i, int j, int k, Particle &particle);
 
@@ -339,6 +402,8 @@ private:
 
     void insert_into_grid(int i, int j, int k);
 
+    void wrap_particles();
+
     void update_grid();
 
     void update_densities();
@@ -356,15 +421,52 @@ private:
     void add_to_grid(GridElement *target_grid, Particle &particle);
 };
 
+struct CheckpointHeader
+{
+    char magic[8];
+    int version;
+    int particle_size;
+
+    int grid_width;
+    int grid_height;
+    int grid_depth;
+    int periodic;
+
+    float core_radius;
+    float timestep;
+
+    float gas_constant;
+    float mu;
+    float rest_density;
+    float sigma;
+    float point_damping;
+
+    float phase;
+    int count;
+};
+
 class Wave
 {
 public:
-    Wave(float _x, float _y, float _z);
+    // _tiles > 0 makes an open-sea tile wrapping in x / z, drawn _tiles x _tiles times
+    // by placing copies of voxels at offsets
+    Wave(float _x, float _y, float _z, const char *checkpoint = NULL, int _tiles = 0);
     ~Wave();
 
     float xPos, yPos, zPos;
+    int tiles;
     vector<Voxel> voxels;
+
+    // where voxels is drawn relative to the wave's origin, only the open-sea
+    // tile is repeated
+    vector<glm::vec3> offsets;
+
+    // heightfield LOD for the water around a closed tank
+    ShallowWater *far_field;
+
     void update();
+
+    bool save(const char *path);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "worker.h"
+
+#include <algorithm>
+
+// the pool whose job this thread is running, nested calls on it run inline
+static thread_local WorkerPool *running = NULL;
+
+WorkerPool::WorkerPool(int threads)
+{
+    job    = NULL;
+    count  = 0;
+    grain  = 1;
+    next   = 0;
+    active = 0;
+    batch  = 0;
+    quit   = false;
+
+    for (int i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+
+    wake.notify_all();
+
+    for (int i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+WorkerPool &WorkerPool::shared()
+{
+    // the render thread works too, so leave one core to it
+    static WorkerPool pool(std::max(1, (int) std::thread::hardware_concurrency() - 1));
+    return pool;
+}
+
+int WorkerPool::size()
+{
+    return workers.size() + 1;
+}
+
+void WorkerPool::drain()
+{
+    while (true)
+    {
+        int begin = next.fetch_add(grain);
+
+        if (begin >= count)
+        {
+            break;
+        }
+
+        (*job)(begin, std::min(begin + grain, count));
+    }
+}
+
+void WorkerPool::work()
+{
+    unsigned long seen = 0;
+
+    running = this;
+
+    while (true)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&] { return quit || batch != seen; });
+
+        if (quit)
+        {
+            return;
+        }
+
+        seen = batch;
+        guard.unlock();
+
+        drain();
+
+        guard.lock();
+
+        if (--active == 0)
+        {
+            finished.notify_one();
+        }
+    }
+}
+
+void WorkerPool::parallel_for(int count, int grain, const std::function<void(int, int)> &job)
+{
+    grain = std::max(grain, 1);
+
+    // not worth waking anyone up, or we are already one of the threads
+    if (count <= grain || workers.empty() || running == this)
+    {
+        if (count > 0)
+        {
+            job(0, count);
+        }
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> serial(calls);
+    std::unique_lock<std::mutex> guard(lock);
+
+    this->job   = &job;
+    this->count = count;
+    this->grain = grain;
+    next        = 0;
+    active      = workers.size();
+    batch++;
+
+    guard.unlock();
+    wake.notify_all();
+
+    WorkerPool *outer = running;
+    running = this;
+
+    drain();
+
+    running = outer;
+
+    guard.lock();
+    finished.wait(guard, [&] { return active == 0; });
+}
@@ -0,0 +1,52 @@
+#ifndef WORKER_H_
+#define WORKER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    Persistent worker threads for data parallel loops
+*/
+
+class WorkerPool
+{
+public:
+    WorkerPool(int threads);
+    ~WorkerPool();
+
+    // worker threads plus the calling thread
+    int size();
+
+    // split [0, count) into chunks of grain items and run them on all
+    // threads, returns when every chunk is done. A call made from inside a
+    // job on the same pool runs the whole range inline on that thread
+    void parallel_for(int count, int grain, const std::function<void(int, int)> &job);
+
+    static WorkerPool &shared();
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex calls;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const std::function<void(int, int)> *job;
+    int count;
+    int grain;
+    std::atomic<int> next;
+
+    int active;
+    unsigned long batch;
+    bool quit;
+
+    void work();
+    void drain();
+};
+
+#endif